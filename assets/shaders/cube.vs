@@ -1,14 +1,10 @@
 #version 330
 
-// matrices
-uniform mat4 m;
-uniform mat4 v;
-uniform mat4 p;
-uniform mat3 normalMatrix;
+#include "uniforms.glsl"
 
-// position of light and camera
-uniform vec3 cameraPosition;
-uniform vec4 lightPosition; // w=0: Spotlight, w=1: Global light
+// origin of every block of vertices in the mesh arena, chunks are only ever translated
+uniform isamplerBuffer origins;
+const int originBlockSize = 64; // mesh_arena::block_size
 
 // attributes
 in vec3 v_coord;
@@ -25,16 +21,16 @@ out vec3 f_uv;
 
 void main(void) {
 	// position in world space
-	vec4 worldPosition = m * vec4(v_coord, 1);
+	vec4 worldPosition = vec4(v_coord + vec3(texelFetch(origins, gl_VertexID / originBlockSize).xyz), 1);
 
 	// direction to light
-	f_toLight = lightPosition.xyz - worldPosition.xyz;
+	f_toLight = lightPosition - worldPosition.xyz;
 
 	// direction to camera
 	f_toCamera = cameraPosition - worldPosition.xyz;
 
 	// normal in world space
-	f_normal = normalMatrix * v_normal;
+	f_normal = v_normal;
 
 	// texture coordinates to fragment shader
 	f_uv = v_uv;
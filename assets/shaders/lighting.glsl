@@ -0,0 +1,43 @@
+// Blinn-Phong lighting, included by fragment shaders
+//
+// LIGHT_SPOT: a spotlight at lightPosition shining along lightDirection, attenuated by angle and distance
+// otherwise:  a point light at lightPosition without any attenuation
+
+#include "uniforms.glsl"
+
+
+// Sum of the ambient, diffuse and specular intensity for the given, not yet normalized vectors
+vec3 lighting(vec3 toLight, vec3 toCamera, vec3 normal) {
+	vec3 L = normalize(toLight);
+	vec3 V = normalize(toCamera);
+	vec3 N = normalize(normal);
+
+#ifdef LIGHT_SPOT
+	vec3 D = normalize(-lightDirection);
+	float dotNL = dot(N, D);
+#else
+	float dotNL = dot(N, L);
+#endif
+
+	vec3 Iamb = matAmbientReflectance * lightAmbientIntensity;
+
+	if (dotNL <= 0.0) {
+		return Iamb;
+	}
+
+#ifdef LIGHT_SPOT
+	float clampedCosine = clamp(dot(L, D) + lightSpotOffset, 0.0, 1.0);
+
+	float distance = length(toLight);
+	float attenuation = pow(clampedCosine, lightSpotExponent) * (1.0 / (lightSpotAttenuationStatic + lightSpotAttenuationLinear * distance + lightSpotAttenuationCubic * distance * distance));
+#else
+	float attenuation = 1.0;
+#endif
+
+	vec3 Idif = attenuation * matDiffuseReflectance * lightDiffuseIntensity * dotNL;
+
+	vec3 H = normalize(L + V); // halfway vector
+	vec3 Ispe = attenuation * matSpecularReflectance * lightSpecularIntensity * pow(dot(N, H), matShininess);
+
+	return Iamb + Idif + Ispe;
+}
@@ -0,0 +1,38 @@
+// Uniform blocks shared by all programs, each bound to the same binding point in every program using it
+//
+// Their std140 layout is mirrored by frame_uniforms and material_uniforms in main.cc,
+// every vec3 is followed by a float so that both agree on the padding.
+
+#ifndef UNIFORMS_GLSL
+#define UNIFORMS_GLSL
+
+// Written once per frame
+layout(std140) uniform frame {
+	// matrices
+	mat4 v;
+	mat4 p;
+
+	// position of the camera and the light
+	vec3 cameraPosition;
+	float lightSpotAttenuationStatic; // = 0.25
+	vec3 lightPosition;
+	float lightSpotAttenuationLinear; // = 0.0
+	vec3 lightDirection; // only used if the light source is a spotlight
+	float lightSpotAttenuationCubic; // = 0.01
+
+	vec3 lightAmbientIntensity; // = vec3(0.6, 0.3, 0);
+	float lightSpotOffset; // = -0.02 | increases or decreases the reflectance - useful if you want to prevent specular spots at short distances
+	vec3 lightDiffuseIntensity; // = vec3(1, 0.5, 0);
+	float lightSpotExponent; // = 20.0 | the lower the value the wider the spotlight
+	vec3 lightSpecularIntensity; // = vec3(0, 1, 0);
+};
+
+// Written once, every block type shares the same material
+layout(std140) uniform material {
+	vec3 matAmbientReflectance; // = vec3(1, 1, 1);
+	float matShininess; // = 16;
+	vec3 matDiffuseReflectance; // = vec3(1, 1, 1);
+	vec3 matSpecularReflectance; // = vec3(1, 1, 1);
+};
+
+#endif
@@ -2,6 +2,10 @@
 	'target_defaults': {
 		'configurations': {
 			'Debug': {
+				# Compiles in the frame profiler, see src/profiler.h
+				'defines': [
+					'GLCRAFT_PROFILE',
+				],
 				'xcode_settings': {
 					'COPY_PHASE_STRIP': 'NO',
 				},
@@ -34,16 +38,65 @@
 			'sources': [
 				'assets/shaders/cube.fs',
 				'assets/shaders/cube.vs',
+				'assets/shaders/lighting.glsl',
+				'assets/shaders/uniforms.glsl',
 				'assets/shaders/white.fs',
 				'assets/shaders/white.vs',
 				'assets/textures/textures.png',
 				'deps/lodepng/picopng.cc',
 				'deps/lodepng/picopng.h',
+				'src/chunk.cc',
+				'src/chunk.h',
+				'src/frustum.cc',
+				'src/frustum.h',
 				'src/gl_service.cc',
 				'src/gl_service.h',
+				'src/gpu_timer.cc',
+				'src/gpu_timer.h',
 				'src/main.cc',
+				'src/mesh_arena.cc',
+				'src/mesh_arena.h',
+				'src/noise.cc',
+				'src/noise.h',
+				'src/occlusion.cc',
+				'src/occlusion.h',
+				'src/profiler.cc',
+				'src/profiler.h',
+				'src/program_cache.cc',
+				'src/program_cache.h',
+				'src/radix_sort.cc',
+				'src/radix_sort.h',
+				'src/region.cc',
+				'src/region.h',
+				'src/scheduler.cc',
+				'src/scheduler.h',
+				'src/stream_buffer.cc',
+				'src/stream_buffer.h',
+				'src/superchunk.cc',
+				'src/superchunk.h',
+				'src/trace.cc',
+				'src/trace.h',
+				'src/world.h',
+				'src/worldgen.cc',
+				'src/worldgen.h',
 			],
 			'conditions': [
+				['OS=="linux"', {
+					# Headless rendering through a surfaceless EGL context
+					'defines': [
+						'GLCRAFT_EGL',
+					],
+					# The trace recorder is thread-safe
+					'cflags': [
+						'-pthread',
+					],
+					'link_settings': {
+						'libraries': [
+							'-lEGL',
+							'-pthread',
+						],
+					},
+				}],
 				['OS=="mac"', {
 					'sources': [
 						'src/Info.plist',
@@ -55,6 +108,8 @@
 							'files': [
 								'assets/shaders/cube.fs',
 								'assets/shaders/cube.vs',
+								'assets/shaders/lighting.glsl',
+								'assets/shaders/uniforms.glsl',
 								'assets/shaders/white.fs',
 								'assets/shaders/white.vs',
 							],
@@ -82,5 +137,79 @@
 				}],
 			],
 		},
+		{
+			'target_name': 'glcraft_pregen',
+			'type': 'executable',
+			'sources': [
+				'src/noise.cc',
+				'src/noise.h',
+				'src/pregen.cc',
+				'src/region.cc',
+				'src/region.h',
+				'src/world.h',
+				'src/worldgen.cc',
+				'src/worldgen.h',
+			],
+			'msvs_settings': {
+				'VCLinkerTool': {
+					'SubSystem': '1',
+				},
+			},
+			'conditions': [
+				['OS=="linux"', {
+					'cflags': [
+						'-pthread',
+					],
+					'link_settings': {
+						'libraries': [
+							'-pthread',
+						],
+					},
+				}],
+				['OS=="mac"', {
+					'xcode_settings': {
+						'CLANG_CXX_LANGUAGE_STANDARD': 'c++11',
+						'CLANG_CXX_LIBRARY': 'libc++',
+						'MACOSX_DEPLOYMENT_TARGET': '10.9',
+					},
+				}],
+			],
+		},
+		{
+			'target_name': 'glcraft_simulate',
+			'type': 'executable',
+			# The world without any GL, to check it stays that way
+			'include_dirs': [
+				'deps/glm',
+			],
+			'sources': [
+				'src/chunk.cc',
+				'src/chunk.h',
+				'src/noise.cc',
+				'src/noise.h',
+				'src/region.cc',
+				'src/region.h',
+				'src/simulate.cc',
+				'src/superchunk.cc',
+				'src/superchunk.h',
+				'src/world.h',
+				'src/worldgen.cc',
+				'src/worldgen.h',
+			],
+			'msvs_settings': {
+				'VCLinkerTool': {
+					'SubSystem': '1',
+				},
+			},
+			'conditions': [
+				['OS=="mac"', {
+					'xcode_settings': {
+						'CLANG_CXX_LANGUAGE_STANDARD': 'c++11',
+						'CLANG_CXX_LIBRARY': 'libc++',
+						'MACOSX_DEPLOYMENT_TARGET': '10.9',
+					},
+				}],
+			],
+		},
 	],
 }
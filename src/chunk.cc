@@ -0,0 +1,518 @@
+#include "chunk.h"
+
+#include <cstring>
+
+
+#define TYPE_TO_UV(type, x, y) glm::i8vec3((x), (y), (type))
+
+/*{ "air", "dirt", "topsoil", "grass", "leaves", "wood", "stone", "sand", "water", "glass", "brick", "ore", "woodrings", "white", "black", "x-y" }*/
+static const int transparent[16] = {2, 0, 0, 0, 1, 0, 0, 0, 3, 4, 0, 0, 0, 0, 0, 0};
+
+
+chunk::chunk(int x, int y, int z) : _left(0), _right(0), _below(0), _above(0), _front(0), _back(0), _ax(x), _ay(y), _az(z), _changed(true), _meshed(false), _noised(false), _initialized(false) {
+	memset(this->_blk, 0, sizeof(this->_blk));
+	memset(this->_connectivity, 0xff, sizeof(this->_connectivity));
+}
+
+bool chunk::isblocked(int x1, int y1, int z1, int x2, int y2, int z2) {
+	// Invisible blocks are always "blocked"
+	if (!this->_blk[x1][y1][z1]) {
+		return true;
+	}
+
+	// Leaves do not block any other block, including themselves
+	if (transparent[this->get(x2, y2, z2)] == 1) {
+		return false;
+	}
+
+	// Non-transparent blocks always block line of sight
+	if (!transparent[this->get(x2, y2, z2)]) {
+		return true;
+	}
+
+	// Otherwise, LOS is only blocked by blocks if the same transparency type
+	return transparent[this->get(x2, y2, z2)] == transparent[this->_blk[x1][y1][z1]];
+}
+
+void chunk::set(int x, int y, int z, uint8_t type) {
+	// If coordinates are outside this chunk, find the right one.
+	if (x < 0) {
+		if (this->_left) {
+			this->_left->set(x + CX, y, z, type);
+		}
+
+		return;
+	}
+
+	if (x >= CX) {
+		if (this->_right) {
+			this->_right->set(x - CX, y, z, type);
+		}
+
+		return;
+	}
+
+	if (y < 0) {
+		if (this->_below) {
+			this->_below->set(x, y + CY, z, type);
+		}
+
+		return;
+	}
+
+	if (y >= CY) {
+		if (this->_above) {
+			this->_above->set(x, y - CY, z, type);
+		}
+
+		return;
+	}
+
+	if (z < 0) {
+		if (this->_front) {
+			this->_front->set(x, y, z + CZ, type);
+		}
+
+		return;
+	}
+
+	if (z >= CZ) {
+		if (this->_back) {
+			this->_back->set(x, y, z - CZ, type);
+		}
+
+		return;
+	}
+
+	// Change the block
+	this->_blk[x][y][z] = type;
+	this->_changed = true;
+
+	// When updating blocks at the edge of this chunk,
+	// visibility of blocks in the neighbouring chunk might change.
+	if (x == 0 && this->_left) {
+		this->_left->_changed = true;
+	}
+
+	if (x == CX - 1 && this->_right) {
+		this->_right->_changed = true;
+	}
+
+	if (y == 0 && this->_below) {
+		this->_below->_changed = true;
+	}
+
+	if (y == CY - 1 && this->_above) {
+		this->_above->_changed = true;
+	}
+
+	if (z == 0 && this->_front) {
+		this->_front->_changed = true;
+	}
+
+	if (z == CZ - 1 && this->_back) {
+		this->_back->_changed = true;
+	}
+}
+
+void chunk::noise(worldgen& gen) {
+	if (this->_noised) {
+		return;
+	}
+
+	this->_noised = true;
+	this->_changed = true;
+
+	const worldgen::column& col = gen.heightmap(this->_ax, this->_az);
+	gen.strata(this->_blk, col, this->_ax, this->_ay, this->_az);
+	gen.fluids(this->_blk, col, this->_ay);
+	gen.decoration(*this, col, this->_ax, this->_ay, this->_az);
+}
+
+// Builds the faces visible from the outside of the chunk into _mesh_vertex, _mesh_normal and _mesh_uv
+void chunk::mesh() {
+	glm::i8vec3* vertex = new glm::i8vec3[CX * CY * CZ * 18];
+	glm::i8vec3* normal = new glm::i8vec3[CX * CY * CZ * 18];
+	glm::i8vec3* uv = new glm::i8vec3[CX * CY * CZ * 18];
+
+	size_t i = 0;
+
+	// View from negative x
+
+	for (int x = CX - 1; x >= 0; x--) {
+		for (int y = 0; y < CY; y++) {
+			for (int z = 0; z < CZ; z++) {
+				// Line of sight blocked?
+				if (this->isblocked(x, y, z, x - 1, y, z)) {
+					continue;
+				}
+
+				const uint8_t type = this->_blk[x][y][z];
+				uint8_t top = type;
+				uint8_t bottom = type;
+				uint8_t side = type;
+
+				// Grass block has dirt sides and bottom
+				if (top == 3) {
+					bottom = 1;
+					side = 2;
+					// Wood blocks have rings on top and bottom
+				} else if (top == 5) {
+					top = bottom = 12;
+				}
+
+				vertex[i + 0] = glm::i8vec3(x, y, z);
+				vertex[i + 1] = glm::i8vec3(x, y, z + 1);
+				vertex[i + 2] = glm::i8vec3(x, y + 1, z);
+				vertex[i + 3] = glm::i8vec3(x, y + 1, z);
+				vertex[i + 4] = glm::i8vec3(x, y, z + 1);
+				vertex[i + 5] = glm::i8vec3(x, y + 1, z + 1);
+
+				normal[i + 0] = glm::i8vec3(-1, 0, 0);
+				normal[i + 1] = glm::i8vec3(-1, 0, 0);
+				normal[i + 2] = glm::i8vec3(-1, 0, 0);
+				normal[i + 3] = glm::i8vec3(-1, 0, 0);
+				normal[i + 4] = glm::i8vec3(-1, 0, 0);
+				normal[i + 5] = glm::i8vec3(-1, 0, 0);
+
+				uv[i + 0] = TYPE_TO_UV(side, 0.0f, 0.0f);
+				uv[i + 1] = TYPE_TO_UV(side, 0.0f, 1.0f);
+				uv[i + 2] = TYPE_TO_UV(side, 1.0f, 0.0f);
+				uv[i + 3] = TYPE_TO_UV(side, 1.0f, 0.0f);
+				uv[i + 4] = TYPE_TO_UV(side, 0.0f, 1.0f);
+				uv[i + 5] = TYPE_TO_UV(side, 1.0f, 1.0f);
+
+				i += 6;
+			}
+		}
+	}
+
+	// View from positive x
+
+	for (int x = 0; x < CX; x++) {
+		for (int y = 0; y < CY; y++) {
+			for (int z = 0; z < CZ; z++) {
+				if (this->isblocked(x, y, z, x + 1, y, z)) {
+					continue;
+				}
+
+				const uint8_t type = this->_blk[x][y][z];
+				uint8_t top = type;
+				uint8_t bottom = type;
+				uint8_t side = type;
+
+				if (top == 3) {
+					bottom = 1;
+					side = 2;
+				} else if (top == 5) {
+					top = bottom = 12;
+				}
+
+				vertex[i + 0] = glm::i8vec3(x + 1, y, z);
+				vertex[i + 1] = glm::i8vec3(x + 1, y + 1, z);
+				vertex[i + 2] = glm::i8vec3(x + 1, y, z + 1);
+				vertex[i + 3] = glm::i8vec3(x + 1, y + 1, z);
+				vertex[i + 4] = glm::i8vec3(x + 1, y + 1, z + 1);
+				vertex[i + 5] = glm::i8vec3(x + 1, y, z + 1);
+
+				normal[i + 0] = glm::i8vec3(1, 0, 0);
+				normal[i + 1] = glm::i8vec3(1, 0, 0);
+				normal[i + 2] = glm::i8vec3(1, 0, 0);
+				normal[i + 3] = glm::i8vec3(1, 0, 0);
+				normal[i + 4] = glm::i8vec3(1, 0, 0);
+				normal[i + 5] = glm::i8vec3(1, 0, 0);
+
+				uv[i + 0] = TYPE_TO_UV(side, 0.0f, 0.0f);
+				uv[i + 1] = TYPE_TO_UV(side, 1.0f, 0.0f);
+				uv[i + 2] = TYPE_TO_UV(side, 0.0f, 1.0f);
+				uv[i + 3] = TYPE_TO_UV(side, 1.0f, 0.0f);
+				uv[i + 4] = TYPE_TO_UV(side, 1.0f, 1.0f);
+				uv[i + 5] = TYPE_TO_UV(side, 0.0f, 1.0f);
+
+				i += 6;
+			}
+		}
+	}
+
+	// View from negative y
+
+	for (int x = 0; x < CX; x++) {
+		for (int y = CY - 1; y >= 0; y--) {
+			for (int z = 0; z < CZ; z++) {
+				if (this->isblocked(x, y, z, x, y - 1, z)) {
+					continue;
+				}
+
+				const uint8_t type = this->_blk[x][y][z];
+				uint8_t top = type;
+				uint8_t bottom = type;
+
+				if (top == 3) {
+					bottom = 1;
+				} else if (top == 5) {
+					top = bottom = 12;
+				}
+
+				vertex[i + 0] = glm::i8vec3(x, y, z);
+				vertex[i + 1] = glm::i8vec3(x + 1, y, z);
+				vertex[i + 2] = glm::i8vec3(x, y, z + 1);
+				vertex[i + 3] = glm::i8vec3(x + 1, y, z);
+				vertex[i + 4] = glm::i8vec3(x + 1, y, z + 1);
+				vertex[i + 5] = glm::i8vec3(x, y, z + 1);
+
+				normal[i + 0] = glm::i8vec3(0, -1, 0);
+				normal[i + 1] = glm::i8vec3(0, -1, 0);
+				normal[i + 2] = glm::i8vec3(0, -1, 0);
+				normal[i + 3] = glm::i8vec3(0, -1, 0);
+				normal[i + 4] = glm::i8vec3(0, -1, 0);
+				normal[i + 5] = glm::i8vec3(0, -1, 0);
+
+				uv[i + 0] = TYPE_TO_UV(bottom, 0.0f, 0.0f);
+				uv[i + 1] = TYPE_TO_UV(bottom, 1.0f, 0.0f);
+				uv[i + 2] = TYPE_TO_UV(bottom, 0.0f, 1.0f);
+				uv[i + 3] = TYPE_TO_UV(bottom, 1.0f, 0.0f);
+				uv[i + 4] = TYPE_TO_UV(bottom, 1.0f, 1.0f);
+				uv[i + 5] = TYPE_TO_UV(bottom, 0.0f, 1.0f);
+
+				i += 6;
+			}
+		}
+	}
+
+	// View from positive y
+
+	for (int x = 0; x < CX; x++) {
+		for (int y = 0; y < CY; y++) {
+			for (int z = 0; z < CZ; z++) {
+				if (this->isblocked(x, y, z, x, y + 1, z)) {
+					continue;
+				}
+
+				const uint8_t type = this->_blk[x][y][z];
+				uint8_t top = type;
+				uint8_t bottom = type;
+
+				if (top == 3) {
+					bottom = 1;
+				} else if (top == 5) {
+					top = bottom = 12;
+				}
+
+				vertex[i + 0] = glm::i8vec3(x, y + 1, z);
+				vertex[i + 1] = glm::i8vec3(x, y + 1, z + 1);
+				vertex[i + 2] = glm::i8vec3(x + 1, y + 1, z);
+				vertex[i + 3] = glm::i8vec3(x + 1, y + 1, z);
+				vertex[i + 4] = glm::i8vec3(x, y + 1, z + 1);
+				vertex[i + 5] = glm::i8vec3(x + 1, y + 1, z + 1);
+
+				normal[i + 0] = glm::i8vec3(0, 1, 0);
+				normal[i + 1] = glm::i8vec3(0, 1, 0);
+				normal[i + 2] = glm::i8vec3(0, 1, 0);
+				normal[i + 3] = glm::i8vec3(0, 1, 0);
+				normal[i + 4] = glm::i8vec3(0, 1, 0);
+				normal[i + 5] = glm::i8vec3(0, 1, 0);
+
+				uv[i + 0] = TYPE_TO_UV(top, 0.0f, 0.0f);
+				uv[i + 1] = TYPE_TO_UV(top, 0.0f, 1.0f);
+				uv[i + 2] = TYPE_TO_UV(top, 1.0f, 0.0f);
+				uv[i + 3] = TYPE_TO_UV(top, 1.0f, 0.0f);
+				uv[i + 4] = TYPE_TO_UV(top, 0.0f, 1.0f);
+				uv[i + 5] = TYPE_TO_UV(top, 1.0f, 1.0f);
+
+				i += 6;
+			}
+		}
+	}
+
+	// View from negative z
+
+	for (int x = 0; x < CX; x++) {
+		for (int z = CZ - 1; z >= 0; z--) {
+			for (int y = 0; y < CY; y++) {
+				if (this->isblocked(x, y, z, x, y, z - 1)) {
+					continue;
+				}
+
+				const uint8_t type = this->_blk[x][y][z];
+				uint8_t top = type;
+				uint8_t bottom = type;
+				uint8_t side = type;
+
+				if (top == 3) {
+					bottom = 1;
+					side = 2;
+				} else if (top == 5) {
+					top = bottom = 12;
+				}
+
+				vertex[i + 0] = glm::i8vec3(x, y, z);
+				vertex[i + 1] = glm::i8vec3(x, y + 1, z);
+				vertex[i + 2] = glm::i8vec3(x + 1, y, z);
+				vertex[i + 3] = glm::i8vec3(x, y + 1, z);
+				vertex[i + 4] = glm::i8vec3(x + 1, y + 1, z);
+				vertex[i + 5] = glm::i8vec3(x + 1, y, z);
+
+				normal[i + 0] = glm::i8vec3(0, 0, -1);
+				normal[i + 1] = glm::i8vec3(0, 0, -1);
+				normal[i + 2] = glm::i8vec3(0, 0, -1);
+				normal[i + 3] = glm::i8vec3(0, 0, -1);
+				normal[i + 4] = glm::i8vec3(0, 0, -1);
+				normal[i + 5] = glm::i8vec3(0, 0, -1);
+
+				uv[i + 0] = TYPE_TO_UV(side, 0.0f, 0.0f);
+				uv[i + 1] = TYPE_TO_UV(side, 0.0f, 1.0f);
+				uv[i + 2] = TYPE_TO_UV(side, 1.0f, 0.0f);
+				uv[i + 3] = TYPE_TO_UV(side, 0.0f, 1.0f);
+				uv[i + 4] = TYPE_TO_UV(side, 1.0f, 1.0f);
+				uv[i + 5] = TYPE_TO_UV(side, 1.0f, 0.0f);
+
+				i += 6;
+			}
+		}
+	}
+
+	// View from positive z
+
+	for (int x = 0; x < CX; x++) {
+		for (int z = 0; z < CZ; z++) {
+			for (int y = 0; y < CY; y++) {
+				if (this->isblocked(x, y, z, x, y, z + 1)) {
+					continue;
+				}
+
+				const uint8_t type = this->_blk[x][y][z];
+				uint8_t top = type;
+				uint8_t bottom = type;
+				uint8_t side = type;
+
+				if (top == 3) {
+					bottom = 1;
+					side = 2;
+				} else if (top == 5) {
+					top = bottom = 12;
+				}
+
+				vertex[i + 0] = glm::i8vec3(x, y, z + 1);
+				vertex[i + 1] = glm::i8vec3(x + 1, y, z + 1);
+				vertex[i + 2] = glm::i8vec3(x, y + 1, z + 1);
+				vertex[i + 3] = glm::i8vec3(x, y + 1, z + 1);
+				vertex[i + 4] = glm::i8vec3(x + 1, y, z + 1);
+				vertex[i + 5] = glm::i8vec3(x + 1, y + 1, z + 1);
+
+				normal[i + 0] = glm::i8vec3(0, 0, 1);
+				normal[i + 1] = glm::i8vec3(0, 0, 1);
+				normal[i + 2] = glm::i8vec3(0, 0, 1);
+				normal[i + 3] = glm::i8vec3(0, 0, 1);
+				normal[i + 4] = glm::i8vec3(0, 0, 1);
+				normal[i + 5] = glm::i8vec3(0, 0, 1);
+
+				uv[i + 0] = TYPE_TO_UV(side, 0.0f, 0.0f);
+				uv[i + 1] = TYPE_TO_UV(side, 1.0f, 0.0f);
+				uv[i + 2] = TYPE_TO_UV(side, 0.0f, 1.0f);
+				uv[i + 3] = TYPE_TO_UV(side, 0.0f, 1.0f);
+				uv[i + 4] = TYPE_TO_UV(side, 1.0f, 0.0f);
+				uv[i + 5] = TYPE_TO_UV(side, 1.0f, 1.0f);
+
+				i += 6;
+			}
+		}
+	}
+
+	this->_changed = false;
+	this->_meshed = true;
+
+	this->connect();
+
+	this->_mesh_vertex.assign(vertex, vertex + i);
+	this->_mesh_normal.assign(normal, normal + i);
+	this->_mesh_uv.assign(uv, uv + i);
+
+	delete[] vertex;
+	delete[] normal;
+	delete[] uv;
+}
+
+// Flood fills the non-opaque blocks from the faces of the chunk to find out which faces can see each other
+void chunk::connect() {
+	static const int offsets[face_count][3] = {
+		{ -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 },
+	};
+
+	bool visited[CX][CY][CZ];
+	std::vector<glm::i8vec3> stack;
+
+	memset(visited, 0, sizeof(visited));
+	memset(this->_connectivity, 0, sizeof(this->_connectivity));
+
+	for (int x = 0; x < CX; x++) {
+		for (int y = 0; y < CY; y++) {
+			for (int z = 0; z < CZ; z++) {
+				// Pockets which don't touch any face don't connect anything
+				if (x != 0 && x != CX - 1 && y != 0 && y != CY - 1 && z != 0 && z != CZ - 1) {
+					continue;
+				}
+
+				if (visited[x][y][z] || (this->_blk[x][y][z] && !transparent[this->_blk[x][y][z]])) {
+					continue;
+				}
+
+				uint8_t faces = 0;
+
+				visited[x][y][z] = true;
+				stack.push_back(glm::i8vec3(x, y, z));
+
+				while (!stack.empty()) {
+					const glm::i8vec3 b = stack.back();
+					stack.pop_back();
+
+					for (int face = 0; face < face_count; face++) {
+						const int nx = b.x + offsets[face][0];
+						const int ny = b.y + offsets[face][1];
+						const int nz = b.z + offsets[face][2];
+
+						if (nx < 0 || nx >= CX || ny < 0 || ny >= CY || nz < 0 || nz >= CZ) {
+							faces |= 1 << face;
+							continue;
+						}
+
+						if (visited[nx][ny][nz] || (this->_blk[nx][ny][nz] && !transparent[this->_blk[nx][ny][nz]])) {
+							continue;
+						}
+
+						visited[nx][ny][nz] = true;
+						stack.push_back(glm::i8vec3(nx, ny, nz));
+					}
+				}
+
+				for (int face = 0; face < face_count; face++) {
+					if (faces & (1 << face)) {
+						this->_connectivity[face] |= faces;
+					}
+				}
+			}
+		}
+	}
+}
+
+// Per 4x4 cell it's the height up to which all blocks from the bottom of the chunk are opaque
+void chunk::occluders(uint8_t (&solid)[CX / 4][CZ / 4]) const {
+	for (int cx = 0; cx < CX / 4; cx++) {
+		for (int cz = 0; cz < CZ / 4; cz++) {
+			int h = CY;
+
+			for (int x = cx * 4; x < cx * 4 + 4; x++) {
+				for (int z = cz * 4; z < cz * 4 + 4; z++) {
+					int y = 0;
+
+					while (y < h && this->_blk[x][y][z] && !transparent[this->_blk[x][y][z]]) {
+						y++;
+					}
+
+					h = y;
+				}
+			}
+
+			solid[cx][cz] = uint8_t(h);
+		}
+	}
+}
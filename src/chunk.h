@@ -0,0 +1,96 @@
+#ifndef chunk_h
+#define chunk_h
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "world.h"
+#include "worldgen.h"
+
+
+/*
+ * The blocks of one chunk and its CPU side mesh, without any GL state.
+ * Everything needed to draw it is kept by the renderer, so chunks can be
+ * generated, edited and meshed in processes which never create a GL context.
+ */
+struct chunk {
+	// Faces of a chunk, the opposite face is always face ^ 1
+	enum {
+		face_left,
+		face_right,
+		face_below,
+		face_above,
+		face_front,
+		face_back,
+		face_count
+	};
+
+	chunk* _left;
+	chunk* _right;
+	chunk* _below;
+	chunk* _above;
+	chunk* _front;
+	chunk* _back;
+	uint8_t _blk[CX][CY][CZ];
+	int _ax;
+	int _ay;
+	int _az;
+	std::vector<glm::i8vec3> _mesh_vertex;
+	std::vector<glm::i8vec3> _mesh_normal;
+	std::vector<glm::i8vec3> _mesh_uv;
+	uint8_t _connectivity[face_count]; // faces reachable from each face through non-opaque blocks
+	bool _changed;
+	bool _meshed; // a new mesh is waiting to be picked up
+	bool _noised;
+	bool _initialized;
+
+	chunk(int x, int y, int z);
+
+	chunk* neighbour(int face) const {
+		chunk* const neighbours[face_count] = { this->_left, this->_right, this->_below, this->_above, this->_front, this->_back };
+		return neighbours[face];
+	}
+
+	uint8_t get(int x, int y, int z) const {
+		if (x < 0) {
+			return this->_left ? this->_left->_blk[x + CX][y][z] : 0;
+		}
+
+		if (x >= CX) {
+			return this->_right ? this->_right->_blk[x - CX][y][z] : 0;
+		}
+
+		if (y < 0) {
+			return this->_below ? this->_below->_blk[x][y + CY][z] : 0;
+		}
+
+		if (y >= CY) {
+			return this->_above ? this->_above->_blk[x][y - CY][z] : 0;
+		}
+
+		if (z < 0) {
+			return this->_front ? this->_front->_blk[x][y][z + CZ] : 0;
+		}
+
+		if (z >= CZ) {
+			return this->_back ? this->_back->_blk[x][y][z - CZ] : 0;
+		}
+
+		return this->_blk[x][y][z];
+	}
+
+	bool isblocked(int x1, int y1, int z1, int x2, int y2, int z2);
+	void set(int x, int y, int z, uint8_t type);
+
+	void noise(worldgen& gen);
+	void mesh();
+	void connect();
+
+	// Heights of the opaque boxes standing on the bottom of the chunk, usable as occluders
+	void occluders(uint8_t (&solid)[CX / 4][CZ / 4]) const;
+};
+
+
+#endif // chunk_h
@@ -0,0 +1,87 @@
+#include "frustum.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+# define FRUSTUM_USE_SSE 1
+# include <xmmintrin.h>
+#endif
+
+
+frustum::frustum(const glm::mat4& pv) {
+	// Gribb & Hartmann - each plane is the sum or difference of the 4th and another row of the matrix
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 4; j++) {
+			this->_planes[i * 2 + 0][j] = pv[j][3] + pv[j][i];
+			this->_planes[i * 2 + 1][j] = pv[j][3] - pv[j][i];
+		}
+	}
+
+	for (int i = 0; i < 6; i++) {
+		this->_planes[i] /= glm::length(glm::vec3(this->_planes[i]));
+	}
+}
+
+bool frustum::test(const glm::vec3& min, const glm::vec3& max) const {
+	for (int i = 0; i < 6; i++) {
+		const glm::vec4& plane = this->_planes[i];
+
+		// The corner of the box furthest along the plane's normal
+		const glm::vec3 corner(plane.x >= 0.0f ? max.x : min.x, plane.y >= 0.0f ? max.y : min.y, plane.z >= 0.0f ? max.z : min.z);
+
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void frustum::test(const float* minx, const float* miny, const float* minz, const float* maxx, const float* maxy, const float* maxz, uint8_t* visible, size_t count) const {
+	size_t i = 0;
+
+#ifdef FRUSTUM_USE_SSE
+	// The furthest corner only depends on the signs of the plane normal,
+	// so we can pick the right input arrays once per plane, instead of once per box.
+	const float* xs[6];
+	const float* ys[6];
+	const float* zs[6];
+	__m128 a[6];
+	__m128 b[6];
+	__m128 c[6];
+	__m128 d[6];
+
+	for (int p = 0; p < 6; p++) {
+		const glm::vec4& plane = this->_planes[p];
+
+		xs[p] = plane.x >= 0.0f ? maxx : minx;
+		ys[p] = plane.y >= 0.0f ? maxy : miny;
+		zs[p] = plane.z >= 0.0f ? maxz : minz;
+		a[p] = _mm_set1_ps(plane.x);
+		b[p] = _mm_set1_ps(plane.y);
+		c[p] = _mm_set1_ps(plane.z);
+		d[p] = _mm_set1_ps(plane.w);
+	}
+
+	const __m128 zero = _mm_setzero_ps();
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 outside = zero;
+
+		for (int p = 0; p < 6; p++) {
+			__m128 dist = _mm_add_ps(_mm_mul_ps(a[p], _mm_loadu_ps(xs[p] + i)), d[p]);
+			dist = _mm_add_ps(dist, _mm_mul_ps(b[p], _mm_loadu_ps(ys[p] + i)));
+			dist = _mm_add_ps(dist, _mm_mul_ps(c[p], _mm_loadu_ps(zs[p] + i)));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(dist, zero));
+		}
+
+		const int mask = _mm_movemask_ps(outside);
+		visible[i + 0] = (mask & 1) ? 0 : 1;
+		visible[i + 1] = (mask & 2) ? 0 : 1;
+		visible[i + 2] = (mask & 4) ? 0 : 1;
+		visible[i + 3] = (mask & 8) ? 0 : 1;
+	}
+#endif
+
+	for (; i < count; i++) {
+		visible[i] = this->test(glm::vec3(minx[i], miny[i], minz[i]), glm::vec3(maxx[i], maxy[i], maxz[i])) ? 1 : 0;
+	}
+}
@@ -0,0 +1,31 @@
+#ifndef frustum_h
+#define frustum_h
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+
+/*
+ * View frustum as 6 planes extracted from a projection * view matrix.
+ *
+ * Boxes are tested conservatively: a box is only rejected if it's
+ * entirely on the outer side of at least one plane.
+ */
+class frustum {
+public:
+	explicit frustum(const glm::mat4& pv);
+
+	bool test(const glm::vec3& min, const glm::vec3& max) const;
+
+	// Tests count boxes stored as a structure of arrays, 4 at a time using SSE where available.
+	// visible[i] is set to 1 if the box i intersects the frustum and 0 otherwise.
+	void test(const float* minx, const float* miny, const float* minz, const float* maxx, const float* maxy, const float* maxz, uint8_t* visible, size_t count) const;
+
+private:
+	glm::vec4 _planes[6];
+};
+
+
+#endif // frustum_h
@@ -1,10 +1,23 @@
 #include "gl_service.h"
 
+#ifdef GLCRAFT_EGL
+# include <EGL/egl.h>
+# include <EGL/eglext.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 
+#include "gpu_timer.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include "trace.h"
+
 
 static std::string get_log(GLuint object) {
 	GLint log_length = 0;
@@ -29,7 +42,217 @@ static std::string get_log(GLuint object) {
 }
 
 
-gl_service::gl_service(const std::string& title) : _has_focus(true) {
+// Marks state which hasn't been set through gl_state yet
+static const GLuint unknown = GLuint(-1);
+
+
+gl_state::gl_state() : _issued(0), _suppressed(0) {
+	this->invalidate();
+}
+
+void gl_state::enable(GLenum cap) {
+	const auto it = this->_caps.find(cap);
+
+	if (it != this->_caps.end() && it->second) {
+		this->_suppressed++;
+		return;
+	}
+
+	glEnable(cap);
+	this->_caps[cap] = true;
+	this->_issued++;
+}
+
+void gl_state::disable(GLenum cap) {
+	const auto it = this->_caps.find(cap);
+
+	if (it != this->_caps.end() && !it->second) {
+		this->_suppressed++;
+		return;
+	}
+
+	glDisable(cap);
+	this->_caps[cap] = false;
+	this->_issued++;
+}
+
+void gl_state::cull_face(GLenum mode) {
+	if (this->update(this->_cull_face, mode)) {
+		glCullFace(mode);
+	}
+}
+
+void gl_state::blend_func(GLenum sfactor, GLenum dfactor) {
+	if (this->_blend_sfactor == sfactor && this->_blend_dfactor == dfactor) {
+		this->_suppressed++;
+		return;
+	}
+
+	glBlendFunc(sfactor, dfactor);
+	this->_blend_sfactor = sfactor;
+	this->_blend_dfactor = dfactor;
+	this->_issued++;
+}
+
+void gl_state::use_program(GLuint program) {
+	if (this->update(this->_program, program)) {
+		glUseProgram(program);
+		gl_service::counters().program_bound();
+	}
+}
+
+void gl_state::bind_vertex_array(GLuint array) {
+	if (this->update(this->_vertex_array, array)) {
+		glBindVertexArray(array);
+		gl_service::counters().vertex_array_bound();
+	}
+}
+
+void gl_state::bind_texture(GLuint unit, GLenum target, GLuint texture) {
+	const auto key = std::make_pair(unit, target);
+	const auto it = this->_textures.find(key);
+
+	if (it != this->_textures.end() && it->second == texture) {
+		this->_suppressed++;
+		return;
+	}
+
+	if (this->_active_texture != unit) {
+		glActiveTexture(GL_TEXTURE0 + unit);
+		this->_active_texture = unit;
+		this->_issued++;
+	}
+
+	glBindTexture(target, texture);
+	this->_textures[key] = texture;
+	this->_issued++;
+}
+
+void gl_state::invalidate() {
+	this->_caps.clear();
+	this->_textures.clear();
+	this->_active_texture = unknown;
+	this->_cull_face = unknown;
+	this->_blend_sfactor = unknown;
+	this->_blend_dfactor = unknown;
+	this->_program = unknown;
+	this->_vertex_array = unknown;
+}
+
+size_t gl_state::issued() const {
+	return this->_issued;
+}
+
+size_t gl_state::suppressed() const {
+	return this->_suppressed;
+}
+
+void gl_state::reset_counters() {
+	this->_issued = 0;
+	this->_suppressed = 0;
+}
+
+// Counts the call and returns true if the value differs from the current one
+bool gl_state::update(GLuint& current, GLuint value) {
+	if (current == value) {
+		this->_suppressed++;
+		return false;
+	}
+
+	current = value;
+	this->_issued++;
+	return true;
+}
+
+
+// Triangles rasterized for the given number of vertices, lines and points don't count
+static size_t triangles(GLenum mode, GLsizei count) {
+	switch (mode) {
+	case GL_TRIANGLES:
+		return size_t(count / 3);
+	case GL_TRIANGLE_STRIP:
+	case GL_TRIANGLE_FAN:
+		return count > 2 ? size_t(count - 2) : 0;
+	default:
+		return 0;
+	}
+}
+
+gl_counters::gl_counters() : _current(), _last() {
+}
+
+void gl_counters::draw_arrays(GLenum mode, GLint first, GLsizei count) {
+	glDrawArrays(mode, first, count);
+
+	this->_current.draw_calls++;
+	this->_current.triangles += triangles(mode, count);
+}
+
+void gl_counters::multi_draw_arrays(GLenum mode, const GLint* first, const GLsizei* count, GLsizei drawcount) {
+	glMultiDrawArrays(mode, first, count, drawcount);
+
+	this->_current.draw_calls++;
+
+	for (GLsizei i = 0; i < drawcount; i++) {
+		this->_current.triangles += triangles(mode, count[i]);
+	}
+}
+
+void gl_counters::buffer_data(GLenum target, GLsizeiptr size, const void* data, GLenum usage) {
+	glBufferData(target, size, data, usage);
+
+	// Only allocating storage doesn't upload anything
+	if (data) {
+		this->_current.upload_bytes += size_t(size);
+	}
+}
+
+void gl_counters::buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const void* data) {
+	glBufferSubData(target, offset, size, data);
+	this->_current.upload_bytes += size_t(size);
+}
+
+void gl_counters::uploaded(size_t bytes) {
+	this->_current.upload_bytes += bytes;
+}
+
+void gl_counters::program_bound() {
+	this->_current.program_binds++;
+}
+
+void gl_counters::vertex_array_bound() {
+	this->_current.vertex_array_binds++;
+}
+
+const gl_counters::frame& gl_counters::current() const {
+	return this->_current;
+}
+
+const gl_counters::frame& gl_counters::last() const {
+	return this->_last;
+}
+
+void gl_counters::end_frame() {
+#ifdef GLCRAFT_PROFILE
+	profiler& prof = profiler::instance();
+	prof.set(profiler::counter_draw_calls, double(this->_current.draw_calls));
+	prof.set(profiler::counter_triangles, double(this->_current.triangles));
+	prof.set(profiler::counter_upload_bytes, double(this->_current.upload_bytes));
+	prof.set(profiler::counter_program_binds, double(this->_current.program_binds));
+	prof.set(profiler::counter_vertex_array_binds, double(this->_current.vertex_array_binds));
+#endif
+
+	this->_last = this->_current;
+	this->_current = frame();
+}
+
+
+gl_service::gl_service(const std::string& title, mode m, int width, int height) : _window(nullptr), _time(0.0f), _has_focus(true), _curser_disabled(false), _needs_redraw(false), _mode(m), _width(width), _height(height), _frame_limit(0), _egl_display(nullptr), _egl_context(nullptr), _framebuffer(0), _renderbuffers() {
+	if (m == headless) {
+		this->create_headless_context();
+		return;
+	}
+
 	if (glfwInit() != GL_TRUE) {
 		throw std::runtime_error("glfwInit() != GL_TRUE");
 	}
@@ -39,7 +262,7 @@ gl_service::gl_service(const std::string& title) : _has_focus(true) {
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	this->_window = glfwCreateWindow(640, 480, title.c_str(), nullptr, nullptr);
+	this->_window = glfwCreateWindow(width, height, title.c_str(), nullptr, nullptr);
 
 	if (!this->_window) {
 		glfwTerminate();
@@ -57,9 +280,146 @@ gl_service::gl_service(const std::string& title) : _has_focus(true) {
 }
 
 gl_service::~gl_service() {
+#ifdef GLCRAFT_EGL
+	if (this->_egl_context) {
+		glDeleteFramebuffers(1, &this->_framebuffer);
+		glDeleteRenderbuffers(2, this->_renderbuffers);
+
+		eglMakeCurrent(this->_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(this->_egl_display, this->_egl_context);
+		eglTerminate(this->_egl_display);
+	}
+#endif
+}
+
+void gl_service::create_headless_context() {
+#ifdef GLCRAFT_EGL
+	EGLDisplay display = EGL_NO_DISPLAY;
+
+	// Prefer Mesa's surfaceless platform, which doesn't need a display server at all
+	const auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+
+	if (get_platform_display) {
+		display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	}
+
+	if (display == EGL_NO_DISPLAY) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+		throw std::runtime_error("eglInitialize() failed");
+	}
+
+	this->_egl_display = display;
+
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		throw std::runtime_error("eglBindAPI(EGL_OPENGL_API) failed");
+	}
+
+	// No surface is ever created, so any surface type will do
+	const EGLint config_attributes[] = {
+		EGL_SURFACE_TYPE, 0,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE,
+	};
+
+	EGLConfig config;
+	EGLint configs = 0;
+
+	if (!eglChooseConfig(display, config_attributes, &config, 1, &configs) || configs == 0) {
+		throw std::runtime_error("eglChooseConfig() found no OpenGL config");
+	}
+
+	// Same as the windowed context
+	const EGLint context_attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION_KHR, 3,
+		EGL_CONTEXT_MINOR_VERSION_KHR, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+		EGL_NONE,
+	};
+
+	EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attributes);
+
+	if (context == EGL_NO_CONTEXT) {
+		throw std::runtime_error("eglCreateContext() failed");
+	}
+
+	this->_egl_context = context;
+
+	if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		throw std::runtime_error("eglMakeCurrent() without a surface failed");
+	}
+
+	glewExperimental = GL_TRUE;
+
+	if (glewInit() != GLEW_OK) {
+		throw std::runtime_error("glewInit() != GLEW_OK");
+	}
+
+	// Everything is drawn into this instead of the default framebuffer, which doesn't exist
+	glGenRenderbuffers(2, this->_renderbuffers);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, this->_renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, this->_width, this->_height);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, this->_renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, this->_width, this->_height);
+
+	glGenFramebuffers(1, &this->_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, this->_framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, this->_renderbuffers[0]);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, this->_renderbuffers[1]);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		throw std::runtime_error("headless framebuffer is incomplete");
+	}
+
+	glViewport(0, 0, this->_width, this->_height);
+#else
+	throw std::runtime_error("headless rendering needs EGL, which this build doesn't support");
+#endif
+}
+
+void gl_service::run_headless() {
+	const auto start = std::chrono::steady_clock::now();
+
+	this->emit_reshape_s(this->_width, this->_height);
+
+	for (unsigned int frame = 0; !this->_frame_limit || frame < this->_frame_limit; frame++) {
+		{
+			TRACE_SCOPE("frame");
+
+			float t = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+			gl_service::state().reset_counters();
+
+			{
+				TRACE_SCOPE("display");
+				this->emit_display_s(t - this->_time);
+			}
+
+			this->_time = t;
+
+			// There's no swap to wait for, so finish the frame to keep frame times honest
+			{
+				PROFILE_SCOPE(phase_swap);
+				TRACE_SCOPE("finish");
+				glFinish();
+			}
+
+			gl_service::counters().end_frame();
+			PROFILE_GPU_COLLECT();
+			PROFILE_FRAME();
+		}
+	}
 }
 
 void gl_service::run() {
+	if (this->_mode == headless) {
+		this->run_headless();
+		return;
+	}
+
 	glfwSwapInterval(1);
 
 	glfwSetWindowFocusCallback(this->_window, [](GLFWwindow* window, int got_focus) {
@@ -73,14 +433,10 @@ void gl_service::run() {
 		self->emit_reshape_s(width, height);
 	});
 
+	// Drawing right here would happen in the middle of glfwPollEvents(), so leave it to the next frame of run()
 	glfwSetWindowRefreshCallback(this->_window, [](GLFWwindow* window) {
 		auto self = reinterpret_cast<gl_service*>(glfwGetWindowUserPointer(window));
-
-		float t = float(glfwGetTime());
-		self->emit_display_s(t - self->_time);
-		self->_time = t;
-
-		glfwSwapBuffers(window);
+		self->_needs_redraw = true;
 	});
 
 	glfwSetKeyCallback(this->_window, [](GLFWwindow* window, int key, int scancode, int action, int mods) {
@@ -146,16 +502,40 @@ void gl_service::run() {
 	this->_time = float(glfwGetTime());
 
 	while (!glfwWindowShouldClose(this->_window)) {
-		float t = float(glfwGetTime());
-		this->emit_display_s(t - this->_time);
-		this->_time = t;
+		{
+			TRACE_SCOPE("frame");
 
-		glfwSwapBuffers(this->_window);
+			this->_needs_redraw = false;
 
-		glfwPollEvents();
+			float t = float(glfwGetTime());
+			gl_service::state().reset_counters();
+
+			{
+				TRACE_SCOPE("display");
+				this->emit_display_s(t - this->_time);
+			}
+
+			this->_time = t;
+
+			{
+				PROFILE_SCOPE(phase_swap);
+				TRACE_SCOPE("swap");
+				glfwSwapBuffers(this->_window);
+			}
+
+			{
+				PROFILE_SCOPE(phase_input);
+				TRACE_SCOPE("events");
+				glfwPollEvents();
+			}
 
-		// throttle if the window is not visible etc.
-		while (!_has_focus) {
+			gl_service::counters().end_frame();
+			PROFILE_GPU_COLLECT();
+			PROFILE_FRAME();
+		}
+
+		// throttle if the window is not visible etc., but still redraw it when asked to
+		while (!this->_has_focus && !this->_needs_redraw) {
 			glfwWaitEvents();
 		}
 	}
@@ -170,13 +550,30 @@ float gl_service::time() const {
 void gl_service::set_cursor_disabled(bool disabled) {
 	this->_curser_disabled = disabled;
 
-	if (disabled && this->_has_focus) {
+	if (disabled && this->_has_focus && this->_window) {
 		glfwSetInputMode(this->_window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 	}
 }
 
 void gl_service::set_cursor_position(float xpos, float ypos) {
-	glfwSetCursorPos(this->_window, xpos, ypos);
+	if (this->_window) {
+		glfwSetCursorPos(this->_window, xpos, ypos);
+	}
+}
+
+void gl_service::set_frame_limit(unsigned int frames) {
+	this->_frame_limit = frames;
+}
+
+// There is only ever one context, so its state is shared by everything drawing into it
+gl_state& gl_service::state() {
+	static gl_state state;
+	return state;
+}
+
+gl_counters& gl_service::counters() {
+	static gl_counters counters;
+	return counters;
 }
 
 
@@ -237,6 +634,12 @@ GLuint gl_service::program_from_source(const uint8_t* vsData, const size_t vsSiz
 		GLuint programId = glCreateProgram();
 		glAttachShader(programId, vsId);
 		glAttachShader(programId, fsId);
+
+		// So that program_cache can store the linked binary
+		if (glProgramParameteri) {
+			glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+		}
+
 		glLinkProgram(programId);
 
 		// same as in loadShaderFromFile()
@@ -259,3 +662,127 @@ GLuint gl_service::program_from_source(const uint8_t* vsData, const size_t vsSiz
 	GLuint fsId = loadShaderFromFile(GL_FRAGMENT_SHADER, fsData, fsSize);
 	return linkShaders(vsId, fsId);
 }
+
+// Appends the lines of a shader to out, with its includes expanded
+static void append_shader(std::string& out, const std::string& path, int depth) {
+	if (depth > 16) {
+		throw std::runtime_error("Shader includes nested too deeply!");
+	}
+
+	const auto data = gl_service::load_file(path);
+	const std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+	std::istringstream in(std::string(data.begin(), data.end()));
+	std::string line;
+	int number = 0;
+
+	while (std::getline(in, line)) {
+		number++;
+
+		const size_t begin = line.find_first_not_of(" \t");
+
+		if (begin == std::string::npos || line.compare(begin, 8, "#include") != 0) {
+			out += line;
+			out += '\n';
+			continue;
+		}
+
+		const size_t open = line.find('"', begin + 8);
+		const size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+
+		if (close == std::string::npos) {
+			throw std::runtime_error("Invalid #include in " + path + "!");
+		}
+
+		// Keeps the line numbers in compile errors right
+		out += "#line 1\n";
+		append_shader(out, directory + line.substr(open + 1, close - open - 1), depth + 1);
+		out += "#line " + std::to_string(number + 1) + "\n";
+	}
+}
+
+std::string gl_service::shader_source(const std::string& path, const std::vector<std::string>& defines) {
+	std::string source;
+	append_shader(source, path, 0);
+
+	if (defines.empty()) {
+		return source;
+	}
+
+	// Nothing but comments may precede #version
+	const size_t version = source.find("#version");
+
+	if (version == std::string::npos) {
+		throw std::runtime_error("Shader without #version: " + path + "!");
+	}
+
+	const size_t end = source.find('\n', version);
+	const int line = int(std::count(source.begin(), source.begin() + version, '\n')) + 1;
+
+	std::string header;
+
+	for (const std::string& define : defines) {
+		header += "#define " + define + " 1\n";
+	}
+
+	header += "#line " + std::to_string(line + 1) + "\n";
+
+	if (end == std::string::npos) {
+		return source + '\n' + header;
+	}
+
+	return source.insert(end + 1, header);
+}
+
+
+shader_variants::shader_variants(const std::string& vsPath, const std::string& fsPath, const std::vector<std::string>& features, program_cache* cache) : _vsPath(vsPath), _fsPath(fsPath), _features(features), _cache(cache) {
+	if (features.size() > 32) {
+		throw std::invalid_argument("Too many shader features!");
+	}
+}
+
+shader_variants::~shader_variants() {
+	for (const auto& it : this->_programs) {
+		glDeleteProgram(it.second);
+	}
+}
+
+GLuint shader_variants::program(uint32_t mask) {
+	const auto it = this->_programs.find(mask);
+
+	if (it != this->_programs.end()) {
+		return it->second;
+	}
+
+	std::vector<std::string> defines;
+
+	for (size_t i = 0; i < 32; i++) {
+		if (!(mask & (uint32_t(1) << i))) {
+			continue;
+		}
+
+		if (i >= this->_features.size()) {
+			throw std::invalid_argument("Unknown shader feature!");
+		}
+
+		defines.push_back(this->_features[i]);
+	}
+
+	const std::string vs = gl_service::shader_source(this->_vsPath, defines);
+	const std::string fs = gl_service::shader_source(this->_fsPath, defines);
+
+	GLuint program;
+
+	if (this->_cache) {
+		program = this->_cache->program_from_source(vs, fs);
+	} else {
+		program = gl_service::program_from_source((const uint8_t*)vs.data(), vs.size(), (const uint8_t*)fs.data(), fs.size());
+	}
+
+	this->_programs[mask] = program;
+	return program;
+}
+
+size_t shader_variants::size() const {
+	return this->_programs.size();
+}
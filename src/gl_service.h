@@ -5,7 +5,10 @@
 
 #include <cstdint>
 #include <functional>
+#include <map>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <GL/glew.h>
@@ -45,6 +48,118 @@
 		}
 
 
+/*
+ * Shadow copy of the GL state which is set every frame, filtering out calls which wouldn't change anything.
+ * All changes to the tracked state have to go through here, or the shadow copy goes stale.
+ * State which isn't known yet, like right after creating the context, is always set.
+ */
+class gl_state {
+public:
+	gl_state();
+
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+	void cull_face(GLenum mode);
+	void blend_func(GLenum sfactor, GLenum dfactor);
+	void use_program(GLuint program);
+	void bind_vertex_array(GLuint array);
+
+	// Activates the texture unit as well, if needed
+	void bind_texture(GLuint unit, GLenum target, GLuint texture);
+
+	// Forgets everything, e.g. after deleting objects whose names might be reused
+	void invalidate();
+
+	// Calls passed on to GL and filtered out since the last reset_counters()
+	size_t issued() const;
+	size_t suppressed() const;
+	void reset_counters();
+
+private:
+	bool update(GLuint& current, GLuint value);
+
+	std::unordered_map<GLenum, bool> _caps;
+	std::map<std::pair<GLuint, GLenum>, GLuint> _textures;
+	GLuint _active_texture;
+	GLuint _cull_face;
+	GLuint _blend_sfactor;
+	GLuint _blend_dfactor;
+	GLuint _program;
+	GLuint _vertex_array;
+	size_t _issued;
+	size_t _suppressed;
+};
+
+
+/*
+ * Counts the work handed to GL per frame. Draws and buffer uploads are only counted if they go through here,
+ * program and vertex array binds are counted by gl_state whenever it doesn't filter them out.
+ */
+class gl_counters {
+public:
+	struct frame {
+		size_t draw_calls;
+		size_t triangles;
+		size_t upload_bytes;
+		size_t program_binds;
+		size_t vertex_array_binds;
+	};
+
+	gl_counters();
+
+	void draw_arrays(GLenum mode, GLint first, GLsizei count);
+	void multi_draw_arrays(GLenum mode, const GLint* first, const GLsizei* count, GLsizei drawcount);
+	void buffer_data(GLenum target, GLsizeiptr size, const void* data, GLenum usage);
+	void buffer_sub_data(GLenum target, GLintptr offset, GLsizeiptr size, const void* data);
+
+	// For data which reaches GL in other ways, like through mapped buffers
+	void uploaded(size_t bytes);
+
+	void program_bound();
+	void vertex_array_bound();
+
+	// The frame in progress and the last one which was completed
+	const frame& current() const;
+	const frame& last() const;
+
+	// Also hands the counts to the profiler
+	void end_frame();
+
+private:
+	frame _current;
+	frame _last;
+};
+
+
+class program_cache;
+
+/*
+ * The permutations of a program, selected by a bitmask of features.
+ * Bit i of the mask defines features[i] in both shaders, so that they only contain the code a combination needs.
+ * Each permutation is compiled the first time it's asked for, using the program cache if there is one.
+ */
+class shader_variants {
+public:
+	shader_variants(const std::string& vsPath, const std::string& fsPath, const std::vector<std::string>& features, program_cache* cache = nullptr);
+	~shader_variants();
+
+	shader_variants(const shader_variants&) = delete;
+	shader_variants& operator=(const shader_variants&) = delete;
+
+	GLuint program(uint32_t mask);
+
+	// Permutations compiled so far
+	size_t size() const;
+
+private:
+	std::string _vsPath;
+	std::string _fsPath;
+	std::vector<std::string> _features;
+	program_cache* _cache;
+	std::map<uint32_t, GLuint> _programs;
+};
+
+
 class gl_service {
 	GLFW_ADD_CALLBACK(public, reshape, void, int width, int height)
 	GLFW_ADD_CALLBACK(public, display, void, float delta)
@@ -56,7 +171,17 @@ class gl_service {
 	GLFW_ADD_CALLBACK(public, scroll, void, float xoffset, float yoffset)
 
 public:
-	gl_service(const std::string& title);
+	/*
+	 * Headless services render into a framebuffer object of the given size instead of a window,
+	 * using a surfaceless EGL context. This needs no display server and no GPU, e.g. Mesa's llvmpipe
+	 * is fine, so the renderer can run on build machines. Input callbacks are never called then.
+	 */
+	enum mode {
+		windowed,
+		headless,
+	};
+
+	gl_service(const std::string& title, mode m = windowed, int width = 640, int height = 480);
 	~gl_service();
 
 	void run();
@@ -64,15 +189,41 @@ public:
 	void set_cursor_disabled(bool disabled);
 	void set_cursor_position(float xpos, float ypos);
 
+	// Makes run() return after the given number of frames, 0 for no limit
+	void set_frame_limit(unsigned int frames);
+
+	static gl_state& state();
+	static gl_counters& counters();
 	static std::vector<uint8_t> load_file(const std::string& path);
 	static GLuint program_from_file(const std::string& vsPath, const std::string& fsPath);
 	static GLuint program_from_source(const uint8_t* vsData, const size_t vsSize, const uint8_t* fsData, const size_t fsSize);
 
+	/*
+	 * Reads a shader and replaces every #include "file" line in it with that file, relative to the one including it.
+	 * Each of the defines is added as "#define name 1" right after the #version line.
+	 */
+	static std::string shader_source(const std::string& path, const std::vector<std::string>& defines);
+
 private:
+	void create_headless_context();
+	void run_headless();
+
 	GLFWwindow* _window;
 	float _time;
 	bool _has_focus;
 	bool _curser_disabled;
+	bool _needs_redraw;
+
+	mode _mode;
+	int _width;
+	int _height;
+	unsigned int _frame_limit;
+
+	// EGLDisplay and EGLContext, so that this header doesn't depend on EGL
+	void* _egl_display;
+	void* _egl_context;
+	GLuint _framebuffer;
+	GLuint _renderbuffers[2];
 };
 
 
@@ -0,0 +1,55 @@
+#include "gpu_timer.h"
+
+
+gpu_timer::gpu_timer() {
+}
+
+// Never destroyed, since the context is gone by the time statics are
+gpu_timer& gpu_timer::instance() {
+	static gpu_timer* timer = new gpu_timer;
+	return *timer;
+}
+
+void gpu_timer::begin(profiler::phase p) {
+	GLuint id;
+
+	if (this->_free.empty()) {
+		glGenQueries(1, &id);
+	} else {
+		id = this->_free.back();
+		this->_free.pop_back();
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, id);
+	this->_pending.push_back({ id, p });
+}
+
+void gpu_timer::end() {
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+void gpu_timer::collect() {
+	// The GPU finishes queries in order, so the first one which isn't done ends the search
+	while (!this->_pending.empty()) {
+		const query q = this->_pending.front();
+		GLint available = 0;
+
+		glGetQueryObjectiv(q.id, GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (!available) {
+			break;
+		}
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(q.id, GL_QUERY_RESULT, &elapsed);
+
+		profiler::instance().add(q.phase, double(elapsed) * 1e-9);
+
+		this->_free.push_back(q.id);
+		this->_pending.pop_front();
+	}
+}
+
+size_t gpu_timer::pending() const {
+	return this->_pending.size();
+}
@@ -0,0 +1,66 @@
+#ifndef gpu_timer_h
+#define gpu_timer_h
+
+#include <deque>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "profiler.h"
+
+
+/*
+ * GPU time of render passes, measured with GL_TIME_ELAPSED queries and reported to the profiler.
+ *
+ * Queries come from a pool and are only read back once the GPU says their result is available,
+ * usually a couple of frames later, so measuring never makes the CPU wait for the GPU.
+ * The results are added to the frame during which they became available.
+ * Passes can't be nested, since only one GL_TIME_ELAPSED query may be active at a time.
+ */
+class gpu_timer {
+public:
+	class scope {
+	public:
+		explicit scope(profiler::phase p) {
+			gpu_timer::instance().begin(p);
+		}
+
+		~scope() {
+			gpu_timer::instance().end();
+		}
+	};
+
+	// Must only be used while the GL context is current
+	static gpu_timer& instance();
+
+	void begin(profiler::phase p);
+	void end();
+
+	// Hands every result which is available by now to the profiler
+	void collect();
+
+	size_t pending() const;
+
+private:
+	struct query {
+		GLuint id;
+		profiler::phase phase;
+	};
+
+	gpu_timer();
+
+	std::vector<GLuint> _free;
+	std::deque<query> _pending; // in the order they were issued
+};
+
+
+#ifdef GLCRAFT_PROFILE
+# define PROFILE_GPU_SCOPE(p) gpu_timer::scope PROFILE_CONCAT(profile_gpu_scope_, __LINE__)(profiler::p)
+# define PROFILE_GPU_COLLECT() gpu_timer::instance().collect()
+#else
+# define PROFILE_GPU_SCOPE(p)
+# define PROFILE_GPU_COLLECT()
+#endif
+
+
+#endif // gpu_timer_h
@@ -3,58 +3,115 @@
 # include <io.h>
 #endif
 
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cmath>
 #include <ctime>
 #include <iostream>
 #include <fstream>
+#include <limits>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 
 #include <lodepng/picopng.h>
 
+#include "frustum.h"
 #include "gl_service.h"
+#include "gpu_timer.h"
+#include "mesh_arena.h"
+#include "occlusion.h"
+#include "profiler.h"
+#include "program_cache.h"
+#include "radix_sort.h"
+#include "region.h"
+#include "scheduler.h"
+#include "stream_buffer.h"
+#include "superchunk.h"
+#include "trace.h"
+#include "world.h"
+#include "worldgen.h"
 
 
-// Size of one chunk in blocks
-#define CX 16
-#define CY 32
-#define CZ 16
+// Time in milliseconds the main thread may spend on generating, meshing and uploading chunks per frame
+#define STREAM_BUDGET_MS 4.0
 
-// Number of chunks in the world
-#define SCX 32
-#define SCY 2
-#define SCZ 32
+// Chunks further away from the camera than this are not drawn, in blocks
+#define VIEW_DISTANCE 512.0f
 
-// Sea level
-#define SEALEVEL 4
+// Chunks closer to the camera than this are used as occluders, in blocks
+#define OCCLUDER_DISTANCE 64.0f
 
+// Chunk meshes which haven't been drawn recently are freed once all of them take up more than this
+#define MESH_BUDGET_MB 64
+
+// Bytes of geometry and uniforms which can be streamed per frame, like the selection box
+#define DYNAMIC_DATA_SIZE 65536
+
+// Where the frame profile is written to on exit and when pressing F5, in Debug builds only
+#define PROFILE_PATH "profile.csv"
+
+// Memory for trace events, once it's used up no further events are recorded
+#define TRACE_BUDGET_MB 16
+
+// Where traces are written to when they are stopped with F6 or on exit
+#define TRACE_PATH "trace.json"
+
+// Where linked shader programs are kept between runs
+#define PROGRAM_CACHE_PATH "programs.cache"
+
+
+// Features of the cube shaders, combined into the mask selecting one of cube_variants
+enum cube_feature {
+	cube_light_spot = 1 << 0, // LIGHT_SPOT
+};
+
+// Binding points of the uniform blocks in assets/shaders/uniforms.glsl, the same in every program
+enum uniform_binding {
+	uniform_binding_frame,
+	uniform_binding_material,
+};
+
+// std140 layout of the frame block, every vec3 is padded to 16 bytes by the float after it
+struct frame_uniforms {
+	glm::mat4 v;
+	glm::mat4 p;
+	glm::vec3 cameraPosition;
+	float lightSpotAttenuationStatic;
+	glm::vec3 lightPosition;
+	float lightSpotAttenuationLinear;
+	glm::vec3 lightDirection;
+	float lightSpotAttenuationCubic;
+	glm::vec3 lightAmbientIntensity;
+	float lightSpotOffset;
+	glm::vec3 lightDiffuseIntensity;
+	float lightSpotExponent;
+	glm::vec3 lightSpecularIntensity;
+	float padding;
+};
+
+// std140 layout of the material block
+struct material_uniforms {
+	glm::vec3 matAmbientReflectance;
+	float matShininess;
+	glm::vec3 matDiffuseReflectance;
+	float padding0;
+	glm::vec3 matSpecularReflectance;
+	float padding1;
+};
+
+static program_cache* programs;
+static shader_variants* cube_variants;
 
 static GLuint cube_program;
 static GLuint white_program;
 
-static GLint cube_uniform_m;
-static GLint cube_uniform_v;
-static GLint cube_uniform_p;
-static GLint cube_uniform_cameraPosition;
 static GLint cube_uniform_diffuseTexture;
-static GLint cube_uniform_lightAmbientIntensity;
-static GLint cube_uniform_lightDiffuseIntensity;
-static GLint cube_uniform_lightDirection;
-static GLint cube_uniform_lightPosition;
-static GLint cube_uniform_lightSpecularIntensity;
-static GLint cube_uniform_lightSpotAttenuationCubic;
-static GLint cube_uniform_lightSpotAttenuationLinear;
-static GLint cube_uniform_lightSpotAttenuationStatic;
-static GLint cube_uniform_lightSpotExponent;
-static GLint cube_uniform_lightSpotOffset;
-static GLint cube_uniform_matAmbientReflectance;
-static GLint cube_uniform_matDiffuseReflectance;
-static GLint cube_uniform_matShininess;
-static GLint cube_uniform_matSpecularReflectance;
-static GLint cube_uniform_normalMatrix;
+static GLint cube_uniform_origins;
 
 static GLint cube_attribute_coord;
 static GLint cube_attribute_normal;
@@ -62,8 +119,15 @@ static GLint cube_attribute_uv;
 
 static GLuint textures;
 
+static stream_buffer* dynamic_data;
+
+static frame_uniforms frame_data;
+static GLuint material_ubo;
+static GLint uniform_alignment;
+
 static GLuint box_vao;
-static GLuint box_vbo;
+static GLuint box_origins;
+static GLuint box_origin_texture;
 
 static GLuint cursor_vao;
 static GLuint cursor_vbo;
@@ -83,767 +147,674 @@ static int mx;
 static int my;
 static int mz;
 
+static bool targeted;
 static unsigned int face;
 static unsigned int buildtype = 1;
 
 static unsigned int keys;
 
 #define M_PIf 3.14159265358979323846f
-#define TYPE_TO_UV(type, x, y) glm::i8vec3((x), (y), (type))
-
-/*{ "air", "dirt", "topsoil", "grass", "leaves", "wood", "stone", "sand", "water", "glass", "brick", "ore", "woodrings", "white", "black", "x-y" }*/
-static const int transparent[16] = {2, 0, 0, 0, 1, 0, 0, 0, 3, 4, 0, 0, 0, 0, 0, 0};
-
-struct chunk {
-	chunk* _left;
-	chunk* _right;
-	chunk* _below;
-	chunk* _above;
-	chunk* _front;
-	chunk* _back;
-	uint8_t _blk[CX][CY][CZ];
-	GLuint _vao;
-	GLuint _vbo[3];
-	int _elements;
-	int _ax;
-	int _ay;
-	int _az;
-	bool _changed;
-	bool _noised;
-	bool _initialized;
-
-	chunk() : _left(0), _right(0), _below(0), _above(0), _front(0), _back(0), _elements(0), _ax(0), _ay(0), _az(0), _changed(true), _noised(false), _initialized(false) {
-		glGenBuffers(3, this->_vbo);
-		glGenVertexArrays(1, &this->_vao);
-		memset(this->_blk, 0, sizeof(this->_blk));
-	}
 
-	chunk(int x, int y, int z) : _left(0), _right(0), _below(0), _above(0), _front(0), _back(0), _elements(0), _ax(x), _ay(y), _az(z), _changed(true), _noised(false), _initialized(false) {
-		glGenBuffers(3, this->_vbo);
-		glGenVertexArrays(1, &this->_vao);
-		memset(this->_blk, 0, sizeof(this->_blk));
-	}
+// Distance between the point and the closest point of the box
+static float distance_to_box(const glm::vec3& camera, const glm::vec3& min, const glm::vec3& max) {
+	return glm::length(glm::max(glm::max(min - camera, camera - max), glm::vec3(0.0f)));
+}
 
-	~chunk() {
-		glDeleteVertexArrays(1, &this->_vao);
-		glDeleteBuffers(3, this->_vbo);
-	}
+/*
+ * Streams the chunks of a superchunk in, uploads their meshes and draws whatever is visible.
+ * All GL state of the chunks lives in here, the superchunk itself doesn't know about GL.
+ */
+struct world_renderer {
+	// What has been uploaded of a chunk
+	struct chunk_mesh {
+		GLint first; // in the mesh arena, or -1
+		int elements;
+		unsigned int drawn_frame;
+		uint8_t solid[CX / 4][CZ / 4];
+		bool streamed;
+	};
 
-	uint8_t get(int x, int y, int z) const {
-		if (x < 0) {
-			return this->_left ? this->_left->_blk[x + CX][y][z] : 0;
-		}
+	/*
+	 * Quadtree over the chunk columns. Every node stores the bounds of its up to 4 children
+	 * as a structure of arrays, so that frustum::test() can check all of them at once.
+	 * Subtrees which are entirely empty are skipped without testing them at all.
+	 */
+	struct cull_node {
+		float minx[4];
+		float miny[4];
+		float minz[4];
+		float maxx[4];
+		float maxy[4];
+		float maxz[4];
+		int child[4]; // index of the child node, or -1 - column index (x * SCZ + z) for leaves
+		bool empty[4];
+		int count;
+		int parent;
+		int slot;
+	};
 
-		if (x >= CX) {
-			return this->_right ? this->_right->_blk[x - CX][y][z] : 0;
-		}
+	superchunk& _world;
+	scheduler _scheduler;
+	mesh_arena _arena;
+	chunk_mesh _meshes[SCX * SCY * SCZ];
+
+	// Meshes drawn least recently are evicted while all meshes together exceed the budget
+	size_t _mesh_budget;
+	size_t _mesh_bytes;
+	size_t _evicted;
+	std::vector<int> _evictable;
+
+	// Bounding boxes of all chunks as a structure of arrays for frustum::test(), in the same order as the chunks
+	float _minx[SCX * SCY * SCZ];
+	float _miny[SCX * SCY * SCZ];
+	float _minz[SCX * SCY * SCZ];
+	float _maxx[SCX * SCY * SCZ];
+	float _maxy[SCX * SCY * SCZ];
+	float _maxz[SCX * SCY * SCZ];
+
+	std::vector<cull_node> _nodes;
+	int _column_node[SCX * SCZ];
+	int _column_slot[SCX * SCZ];
+	bool _column_dirty[SCX * SCZ];
+	std::vector<int> _dirty_columns;
+
+	// Chunks which haven't been generated, meshed and uploaded for the first time yet
+	std::vector<chunk*> _streaming;
+
+	// Indices of the chunks which passed culling this frame
+	std::vector<int> _drawlist;
+	unsigned int _visible_frame[SCX * SCY * SCZ];
+	unsigned int _frame;
+
+	// Vertex ranges in the mesh arena submitted with a single draw call
+	std::vector<GLint> _draw_first;
+	std::vector<GLsizei> _draw_count;
+
+	// Drawing front to back lets early depth testing skip shading hidden fragments,
+	// the other orders are there to measure how much that saves.
+	enum draw_order {
+		order_front_to_back,
+		order_back_to_front,
+		order_unsorted,
+		order_count
+	};
 
-		if (y < 0) {
-			return this->_below ? this->_below->_blk[x][y + CY][z] : 0;
-		}
+	draw_order _order;
+	std::vector<uint32_t> _sort_keys;
+	std::vector<uint32_t> _sort_scratch;
+	double _sort_time;
 
-		if (y >= CY) {
-			return this->_above ? this->_above->_blk[x][y - CY][z] : 0;
-		}
+	// Samples passing the depth test, as of the last query the GPU finished. Results are only read once they are
+	// available, so the CPU never waits. Frames are drawn without a query while all of them are still in flight.
+	enum {
+		samples_queries = 4,
+	};
 
-		if (z < 0) {
-			return this->_front ? this->_front->_blk[x][y][z + CZ] : 0;
-		}
+	GLuint _samples_query[samples_queries];
+	unsigned _samples_issued;
+	unsigned _samples_read;
+	GLuint64 _samples;
 
-		if (z >= CZ) {
-			return this->_back ? this->_back->_blk[x][y][z - CZ] : 0;
-		}
+	// Chunk to visit while walking the connectivity graph, entered through the given face
+	struct visit {
+		int index;
+		int from;
+		uint8_t directions;
+	};
 
-		return this->_blk[x][y][z];
-	}
+	// Chunks reachable from the camera through open space this frame
+	std::vector<visit> _visits;
+	unsigned int _reachable_frame[SCX * SCY * SCZ];
+	bool _cave_culling;
+	size_t _unreachable;
 
-	bool isblocked(int x1, int y1, int z1, int x2, int y2, int z2) {
-		// Invisible blocks are always "blocked"
-		if (!this->_blk[x1][y1][z1]) {
-			return true;
-		}
+	occlusion_buffer _occlusion;
+	bool _occlusion_culling;
+	size_t _occluded;
 
-		// Leaves do not block any other block, including themselves
-		if (transparent[this->get(x2, y2, z2)] == 1) {
-			return false;
-		}
+	explicit world_renderer(superchunk& world) : _world(world), _scheduler(STREAM_BUDGET_MS), _arena(cube_attribute_coord, cube_attribute_normal, cube_attribute_uv, 1), _mesh_budget(size_t(MESH_BUDGET_MB) << 20), _mesh_bytes(0), _evicted(0), _column_dirty(), _visible_frame(), _frame(0), _order(order_front_to_back), _sort_time(0.0), _samples_issued(0), _samples_read(0), _samples(0), _reachable_frame(), _cave_culling(true), _unreachable(0), _occlusion_culling(true), _occluded(0) {
+		static_assert(SCX * SCY * SCZ <= 0x10000, "chunk indices must fit into the payload of radix_sort()");
 
-		// Non-transparent blocks always block line of sight
-		if (!transparent[this->get(x2, y2, z2)]) {
-			return true;
-		}
+		glGenQueries(samples_queries, this->_samples_query);
 
-		// Otherwise, LOS is only blocked by blocks if the same transparency type
-		return transparent[this->get(x2, y2, z2)] == transparent[this->_blk[x1][y1][z1]];
-	}
+		for (int i = 0; i < SCX * SCY * SCZ; i++) {
+			chunk* c = world.at(i);
+			chunk_mesh& m = this->_meshes[i];
 
-	void set(int x, int y, int z, uint8_t type) {
-		// If coordinates are outside this chunk, find the right one.
-		if (x < 0) {
-			if (this->_left) {
-				this->_left->set(x + CX, y, z, type);
-			}
+			m.first = -1;
+			m.elements = 0;
+			m.drawn_frame = 0;
+			m.streamed = false;
+			memset(m.solid, 0, sizeof(m.solid));
 
-			return;
+			this->_minx[i] = float(c->_ax * CX);
+			this->_miny[i] = float(c->_ay * CY);
+			this->_minz[i] = float(c->_az * CZ);
+			this->_maxx[i] = float(c->_ax * CX + CX);
+			this->_maxy[i] = float(c->_ay * CY + CY);
+			this->_maxz[i] = float(c->_az * CZ + CZ);
+
+			this->_streaming.push_back(c);
 		}
 
-		if (x >= CX) {
-			if (this->_right) {
-				this->_right->set(x - CX, y, z, type);
-			}
+		this->build_node(0, 0, SCX, SCZ, -1, 0);
 
-			return;
-		}
+		// Edits and newly generated terrain change what the chunks around them look like
+		world.on_touch([this](const chunk* c, int radius) {
+			this->touch(c, radius);
+		});
+	}
 
-		if (y < 0) {
-			if (this->_below) {
-				this->_below->set(x, y + CY, z, type);
-			}
+	~world_renderer() {
+		this->_world.on_touch(nullptr);
+		glDeleteQueries(samples_queries, this->_samples_query);
+	}
 
-			return;
-		}
+	world_renderer(const world_renderer&) = delete;
+	world_renderer& operator=(const world_renderer&) = delete;
+
+	// Builds the quadtree node covering the columns [x0, x1) x [z0, z1) and returns its index
+	int build_node(int x0, int z0, int x1, int z1, int parent, int slot) {
+		const int index = int(this->_nodes.size());
+		const int xm = (x0 + x1 + 1) / 2;
+		const int zm = (z0 + z1 + 1) / 2;
+		const int ranges[4][4] = {
+			{ x0, z0, xm, zm },
+			{ xm, z0, x1, zm },
+			{ x0, zm, xm, z1 },
+			{ xm, zm, x1, z1 },
+		};
 
-		if (y >= CY) {
-			if (this->_above) {
-				this->_above->set(x, y - CY, z, type);
-			}
+		this->_nodes.push_back(cull_node());
+		this->_nodes[index].count = 0;
+		this->_nodes[index].parent = parent;
+		this->_nodes[index].slot = slot;
 
-			return;
-		}
+		for (int i = 0; i < 4; i++) {
+			const int* r = ranges[i];
 
-		if (z < 0) {
-			if (this->_front) {
-				this->_front->set(x, y, z + CZ, type);
+			if (r[0] >= r[2] || r[1] >= r[3]) {
+				continue;
 			}
 
-			return;
-		}
+			const int n = this->_nodes[index].count++;
+			int child;
 
-		if (z >= CZ) {
-			if (this->_back) {
-				this->_back->set(x, y, z - CZ, type);
+			if (r[2] - r[0] == 1 && r[3] - r[1] == 1) {
+				const int column = r[0] * SCZ + r[1];
+				this->_column_node[column] = index;
+				this->_column_slot[column] = n;
+				child = -1 - column;
+			} else {
+				// Careful: this invalidates references into _nodes
+				child = this->build_node(r[0], r[1], r[2], r[3], index, n);
 			}
 
-			return;
+			cull_node& node = this->_nodes[index];
+			node.minx[n] = float((r[0] - SCX / 2) * CX);
+			node.miny[n] = float((-SCY / 2) * CY);
+			node.minz[n] = float((r[1] - SCZ / 2) * CZ);
+			node.maxx[n] = float((r[2] - SCX / 2) * CX);
+			node.maxy[n] = float((SCY - SCY / 2) * CY);
+			node.maxz[n] = float((r[3] - SCZ / 2) * CZ);
+			node.child[n] = child;
+			node.empty[n] = false;
 		}
 
-		// Change the block
-		this->_blk[x][y][z] = type;
-		this->_changed = true;
+		return index;
+	}
 
-		// When updating blocks at the edge of this chunk,
-		// visibility of blocks in the neighbouring chunk might change.
-		if (x == 0 && this->_left) {
-			this->_left->_changed = true;
-		}
+	// Marks the columns within the given radius around the chunk for refresh_columns()
+	void touch(const chunk* c, int radius) {
+		const int cx = c->_ax + SCX / 2;
+		const int cz = c->_az + SCZ / 2;
 
-		if (x == CX - 1 && this->_right) {
-			this->_right->_changed = true;
-		}
+		for (int x = std::max(cx - radius, 0); x <= std::min(cx + radius, SCX - 1); x++) {
+			for (int z = std::max(cz - radius, 0); z <= std::min(cz + radius, SCZ - 1); z++) {
+				const int column = x * SCZ + z;
 
-		if (y == 0 && this->_below) {
-			this->_below->_changed = true;
+				if (!this->_column_dirty[column]) {
+					this->_column_dirty[column] = true;
+					this->_dirty_columns.push_back(column);
+				}
+			}
 		}
+	}
 
-		if (y == CY - 1 && this->_above) {
-			this->_above->_changed = true;
-		}
+	// Updates which columns have nothing to draw and propagates it up the quadtree
+	void refresh_columns() {
+		for (int column : this->_dirty_columns) {
+			const int x = column / SCZ;
+			const int z = column % SCZ;
+			bool empty = true;
 
-		if (z == 0 && this->_front) {
-			this->_front->_changed = true;
-		}
+			for (int y = 0; y < SCY; y++) {
+				const int i = (x * SCY + y) * SCZ + z;
+				const chunk* c = this->_world.at(i);
 
-		if (z == CZ - 1 && this->_back) {
-			this->_back->_changed = true;
-		}
-	}
+				if (!this->_meshes[i].streamed || this->_meshes[i].elements || c->_changed || c->_meshed) {
+					empty = false;
+				}
+			}
 
-	static float noise2d(float x, float y, int seed, int octaves, float persistence) {
-		float sum = 0;
-		float strength = 1.0;
-		float scale = 1.0;
+			int index = this->_column_node[column];
+			int slot = this->_column_slot[column];
 
-		for (int i = 0; i < octaves; i++) {
-			sum += strength * glm::simplex(glm::vec2(x, y) * scale);
-			scale *= 2.0;
-			strength *= persistence;
-		}
+			while (index >= 0 && this->_nodes[index].empty[slot] != empty) {
+				cull_node& node = this->_nodes[index];
+				node.empty[slot] = empty;
 
-		return sum;
-	}
+				for (int i = 0; i < node.count; i++) {
+					empty = empty && node.empty[i];
+				}
 
-	static float noise3d_abs(float x, float y, float z, int seed, int octaves, float persistence) {
-		float sum = 0;
-		float strength = 1.0;
-		float scale = 1.0;
+				index = node.parent;
+				slot = node.slot;
+			}
 
-		for (int i = 0; i < octaves; i++) {
-			sum += strength * fabs(glm::simplex(glm::vec3(x, y, z) * scale));
-			scale *= 2.0;
-			strength *= persistence;
+			this->_column_dirty[column] = false;
 		}
 
-		return sum;
+		this->_dirty_columns.clear();
 	}
 
-	void noise(unsigned int seed) {
-		if (this->_noised) {
-			return;
-		}
+	// Collects the visible chunks below the given node into _drawlist
+	void cull(const frustum& f, const glm::vec3& camera, int index) {
+		const cull_node& node = this->_nodes[index];
+		uint8_t visible[4];
 
-		this->_noised = true;
-
-		for (int x = 0; x < CX; x++) {
-			for (int z = 0; z < CZ; z++) {
-				// Land height
-				float n = noise2d((x + this->_ax * CX) / 256.0f, (z + this->_az * CZ) / 256.0f, seed, 5, 0.8f) * 4.0f;
-				int h = int(n * 2);
-				int y = 0;
-
-				// Land blocks
-				for (y = 0; y < CY; y++) {
-					// Are we above "ground" level?
-					if (y + this->_ay * CY >= h) {
-						// If we are not yet up to sea level, fill with water blocks
-						if (y + this->_ay * CY < SEALEVEL) {
-							this->_blk[x][y][z] = 8;
-							continue;
-							// Otherwise, we are in the air
-						} else {
-							// A tree!
-							if (get(x, y - 1, z) == 3 && (rand() & 0xff) == 0) {
-								// Trunk
-								h = (rand() & 0x3) + 3;
-
-								for (int i = 0; i < h; i++) {
-									set(x, y + i, z, 5);
-								}
-
-								// Leaves
-								for (int ix = -3; ix <= 3; ix++) {
-									for (int iy = -3; iy <= 3; iy++) {
-										for (int iz = -3; iz <= 3; iz++) {
-											if (ix * ix + iy * iy + iz * iz < 8 + (rand() & 1) && !get(x + ix, y + h + iy, z + iz)) {
-												set(x + ix, y + h + iy, z + iz, 4);
-											}
-										}
-									}
-								}
-							}
+		f.test(node.minx, node.miny, node.minz, node.maxx, node.maxy, node.maxz, visible, node.count);
 
-							break;
-						}
-					}
-
-					// Random value used to determine land type
-					float r = noise3d_abs((x + this->_ax * CX) / 16.0f, (y + this->_ay * CY) / 16.0f, (z + this->_az * CZ) / 16.0f, seed, 2, 1.0f);
-
-					if (n + r * 5 < 4) {
-						// Sand layer
-						this->_blk[x][y][z] = 7;
-					} else if (n + r * 5 < 8) {
-						// Dirt layer, but use grass blocks for the top
-						this->_blk[x][y][z] = (h < SEALEVEL || y + this->_ay * CY < h - 1) ? 1 : 3;
-					} else if (r < 1.25) {
-						// Rock layer
-						this->_blk[x][y][z] = 6;
-					} else {
-						// Sometimes, ores!
-						this->_blk[x][y][z] = 11;
-					}
-				}
+		for (int i = 0; i < node.count; i++) {
+			if (node.empty[i] || !visible[i]) {
+				continue;
 			}
-		}
-
-		this->_changed = true;
-	}
-
-	void update() {
-		glm::i8vec3* vertex = new glm::i8vec3[CX * CY * CZ * 18];
-		glm::i8vec3* normal = new glm::i8vec3[CX * CY * CZ * 18];
-		glm::i8vec3* uv = new glm::i8vec3[CX * CY * CZ * 18];
 
-		size_t i = 0;
+			if (distance_to_box(camera, glm::vec3(node.minx[i], node.miny[i], node.minz[i]), glm::vec3(node.maxx[i], node.maxy[i], node.maxz[i])) > VIEW_DISTANCE) {
+				continue;
+			}
 
-		// View from negative x
+			if (node.child[i] >= 0) {
+				this->cull(f, camera, node.child[i]);
+				continue;
+			}
 
-		for (int x = CX - 1; x >= 0; x--) {
-			for (int y = 0; y < CY; y++) {
-				for (int z = 0; z < CZ; z++) {
-					// Line of sight blocked?
-					if (this->isblocked(x, y, z, x - 1, y, z)) {
-						continue;
-					}
+			const int column = -1 - node.child[i];
+			const int x = column / SCZ;
+			const int z = column % SCZ;
 
-					const uint8_t type = this->_blk[x][y][z];
-					uint8_t top = type;
-					uint8_t bottom = type;
-					uint8_t side = type;
-
-					// Grass block has dirt sides and bottom
-					if (top == 3) {
-						bottom = 1;
-						side = 2;
-						// Wood blocks have rings on top and bottom
-					} else if (top == 5) {
-						top = bottom = 12;
-					}
+			for (int y = 0; y < SCY; y++) {
+				const int j = (x * SCY + y) * SCZ + z;
 
-					vertex[i + 0] = glm::i8vec3(x, y, z);
-					vertex[i + 1] = glm::i8vec3(x, y, z + 1);
-					vertex[i + 2] = glm::i8vec3(x, y + 1, z);
-					vertex[i + 3] = glm::i8vec3(x, y + 1, z);
-					vertex[i + 4] = glm::i8vec3(x, y, z + 1);
-					vertex[i + 5] = glm::i8vec3(x, y + 1, z + 1);
-
-					normal[i + 0] = glm::i8vec3(-1, 0, 0);
-					normal[i + 1] = glm::i8vec3(-1, 0, 0);
-					normal[i + 2] = glm::i8vec3(-1, 0, 0);
-					normal[i + 3] = glm::i8vec3(-1, 0, 0);
-					normal[i + 4] = glm::i8vec3(-1, 0, 0);
-					normal[i + 5] = glm::i8vec3(-1, 0, 0);
-
-					uv[i + 0] = TYPE_TO_UV(side, 0.0f, 0.0f);
-					uv[i + 1] = TYPE_TO_UV(side, 0.0f, 1.0f);
-					uv[i + 2] = TYPE_TO_UV(side, 1.0f, 0.0f);
-					uv[i + 3] = TYPE_TO_UV(side, 1.0f, 0.0f);
-					uv[i + 4] = TYPE_TO_UV(side, 0.0f, 1.0f);
-					uv[i + 5] = TYPE_TO_UV(side, 1.0f, 1.0f);
-
-					i += 6;
+				if (f.test(glm::vec3(this->_minx[j], this->_miny[j], this->_minz[j]), glm::vec3(this->_maxx[j], this->_maxy[j], this->_maxz[j]))) {
+					this->_visible_frame[j] = this->_frame;
+					this->_drawlist.push_back(j);
 				}
 			}
 		}
+	}
 
-		// View from positive x
-
-		for (int x = 0; x < CX; x++) {
-			for (int y = 0; y < CY; y++) {
-				for (int z = 0; z < CZ; z++) {
-					if (this->isblocked(x, y, z, x + 1, y, z)) {
-						continue;
-					}
+	// Sorts _drawlist by the distance of the chunks to the camera, quantised to 16 bits
+	void sort(const glm::vec3& camera) {
+		const auto start = std::chrono::steady_clock::now();
 
-					const uint8_t type = this->_blk[x][y][z];
-					uint8_t top = type;
-					uint8_t bottom = type;
-					uint8_t side = type;
+		if (this->_order != order_unsorted) {
+			this->_sort_keys.clear();
 
-					if (top == 3) {
-						bottom = 1;
-						side = 2;
-					} else if (top == 5) {
-						top = bottom = 12;
-					}
+			for (int i : this->_drawlist) {
+				const float d = distance_to_box(camera, glm::vec3(this->_minx[i], this->_miny[i], this->_minz[i]), glm::vec3(this->_maxx[i], this->_maxy[i], this->_maxz[i]));
+				uint32_t key = uint32_t(std::min(d / VIEW_DISTANCE, 1.0f) * 65535.0f);
 
-					vertex[i + 0] = glm::i8vec3(x + 1, y, z);
-					vertex[i + 1] = glm::i8vec3(x + 1, y + 1, z);
-					vertex[i + 2] = glm::i8vec3(x + 1, y, z + 1);
-					vertex[i + 3] = glm::i8vec3(x + 1, y + 1, z);
-					vertex[i + 4] = glm::i8vec3(x + 1, y + 1, z + 1);
-					vertex[i + 5] = glm::i8vec3(x + 1, y, z + 1);
-
-					normal[i + 0] = glm::i8vec3(1, 0, 0);
-					normal[i + 1] = glm::i8vec3(1, 0, 0);
-					normal[i + 2] = glm::i8vec3(1, 0, 0);
-					normal[i + 3] = glm::i8vec3(1, 0, 0);
-					normal[i + 4] = glm::i8vec3(1, 0, 0);
-					normal[i + 5] = glm::i8vec3(1, 0, 0);
-
-					uv[i + 0] = TYPE_TO_UV(side, 0.0f, 0.0f);
-					uv[i + 1] = TYPE_TO_UV(side, 1.0f, 0.0f);
-					uv[i + 2] = TYPE_TO_UV(side, 0.0f, 1.0f);
-					uv[i + 3] = TYPE_TO_UV(side, 1.0f, 0.0f);
-					uv[i + 4] = TYPE_TO_UV(side, 1.0f, 1.0f);
-					uv[i + 5] = TYPE_TO_UV(side, 0.0f, 1.0f);
-
-					i += 6;
+				if (this->_order == order_back_to_front) {
+					key = 65535 - key;
 				}
-			}
-		}
-
-		// View from negative y
-
-		for (int x = 0; x < CX; x++) {
-			for (int y = CY - 1; y >= 0; y--) {
-				for (int z = 0; z < CZ; z++) {
-					if (this->isblocked(x, y, z, x, y - 1, z)) {
-						continue;
-					}
 
-					const uint8_t type = this->_blk[x][y][z];
-					uint8_t top = type;
-					uint8_t bottom = type;
+				this->_sort_keys.push_back(key << 16 | uint32_t(i));
+			}
 
-					if (top == 3) {
-						bottom = 1;
-					} else if (top == 5) {
-						top = bottom = 12;
-					}
+			radix_sort(this->_sort_keys, this->_sort_scratch);
 
-					vertex[i + 0] = glm::i8vec3(x, y, z);
-					vertex[i + 1] = glm::i8vec3(x + 1, y, z);
-					vertex[i + 2] = glm::i8vec3(x, y, z + 1);
-					vertex[i + 3] = glm::i8vec3(x + 1, y, z);
-					vertex[i + 4] = glm::i8vec3(x + 1, y, z + 1);
-					vertex[i + 5] = glm::i8vec3(x, y, z + 1);
-
-					normal[i + 0] = glm::i8vec3(0, -1, 0);
-					normal[i + 1] = glm::i8vec3(0, -1, 0);
-					normal[i + 2] = glm::i8vec3(0, -1, 0);
-					normal[i + 3] = glm::i8vec3(0, -1, 0);
-					normal[i + 4] = glm::i8vec3(0, -1, 0);
-					normal[i + 5] = glm::i8vec3(0, -1, 0);
-
-					uv[i + 0] = TYPE_TO_UV(bottom, 0.0f, 0.0f);
-					uv[i + 1] = TYPE_TO_UV(bottom, 1.0f, 0.0f);
-					uv[i + 2] = TYPE_TO_UV(bottom, 0.0f, 1.0f);
-					uv[i + 3] = TYPE_TO_UV(bottom, 1.0f, 0.0f);
-					uv[i + 4] = TYPE_TO_UV(bottom, 1.0f, 1.0f);
-					uv[i + 5] = TYPE_TO_UV(bottom, 0.0f, 1.0f);
-
-					i += 6;
-				}
+			for (size_t k = 0; k < this->_sort_keys.size(); k++) {
+				this->_drawlist[k] = int(this->_sort_keys[k] & 0xffff);
 			}
 		}
 
-		// View from positive y
+		this->_sort_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	/*
+	 * Walks from the chunk the camera is in to its neighbours through the faces which are connected
+	 * inside each chunk. Steps back towards the camera are not allowed, so every chunk is visited once
+	 * and everything only reachable through solid rock, like caves below the surface, is left out.
+	 */
+	void reach(const frustum& f, const glm::vec3& camera) {
+		const int cx = int(floorf(camera.x / CX)) + SCX / 2;
+		const int cy = int(floorf(camera.y / CY)) + SCY / 2;
+		const int cz = int(floorf(camera.z / CZ)) + SCZ / 2;
 
-		for (int x = 0; x < CX; x++) {
-			for (int y = 0; y < CY; y++) {
-				for (int z = 0; z < CZ; z++) {
-					if (this->isblocked(x, y, z, x, y + 1, z)) {
-						continue;
-					}
+		this->_visits.clear();
 
-					const uint8_t type = this->_blk[x][y][z];
-					uint8_t top = type;
-					uint8_t bottom = type;
+		if (cx >= 0 && cx < SCX && cy >= 0 && cy < SCY && cz >= 0 && cz < SCZ) {
+			const int i = (cx * SCY + cy) * SCZ + cz;
 
-					if (top == 3) {
-						bottom = 1;
-					} else if (top == 5) {
-						top = bottom = 12;
+			this->_reachable_frame[i] = this->_frame;
+			this->_visits.push_back({ i, -1, 0 });
+		} else {
+			// From outside, start at the chunks on the sides of the world facing the camera
+			const bool outside[chunk::face_count] = { cx < 0, cx >= SCX, cy < 0, cy >= SCY, cz < 0, cz >= SCZ };
+
+			for (int x = 0; x < SCX; x++) {
+				for (int y = 0; y < SCY; y++) {
+					for (int z = 0; z < SCZ; z++) {
+						const bool border[chunk::face_count] = { x == 0, x == SCX - 1, y == 0, y == SCY - 1, z == 0, z == SCZ - 1 };
+						const int i = (x * SCY + y) * SCZ + z;
+
+						for (int face = 0; face < chunk::face_count; face++) {
+							if (outside[face] && border[face] && this->_reachable_frame[i] != this->_frame && f.test(glm::vec3(this->_minx[i], this->_miny[i], this->_minz[i]), glm::vec3(this->_maxx[i], this->_maxy[i], this->_maxz[i]))) {
+								this->_reachable_frame[i] = this->_frame;
+								this->_visits.push_back({ i, face, 0 });
+							}
+						}
 					}
-
-					vertex[i + 0] = glm::i8vec3(x, y + 1, z);
-					vertex[i + 1] = glm::i8vec3(x, y + 1, z + 1);
-					vertex[i + 2] = glm::i8vec3(x + 1, y + 1, z);
-					vertex[i + 3] = glm::i8vec3(x + 1, y + 1, z);
-					vertex[i + 4] = glm::i8vec3(x, y + 1, z + 1);
-					vertex[i + 5] = glm::i8vec3(x + 1, y + 1, z + 1);
-
-					normal[i + 0] = glm::i8vec3(0, 1, 0);
-					normal[i + 1] = glm::i8vec3(0, 1, 0);
-					normal[i + 2] = glm::i8vec3(0, 1, 0);
-					normal[i + 3] = glm::i8vec3(0, 1, 0);
-					normal[i + 4] = glm::i8vec3(0, 1, 0);
-					normal[i + 5] = glm::i8vec3(0, 1, 0);
-
-					uv[i + 0] = TYPE_TO_UV(top, 0.0f, 0.0f);
-					uv[i + 1] = TYPE_TO_UV(top, 0.0f, 1.0f);
-					uv[i + 2] = TYPE_TO_UV(top, 1.0f, 0.0f);
-					uv[i + 3] = TYPE_TO_UV(top, 1.0f, 0.0f);
-					uv[i + 4] = TYPE_TO_UV(top, 0.0f, 1.0f);
-					uv[i + 5] = TYPE_TO_UV(top, 1.0f, 1.0f);
-
-					i += 6;
 				}
 			}
 		}
 
-		// View from negative z
-
-		for (int x = 0; x < CX; x++) {
-			for (int z = CZ - 1; z >= 0; z--) {
-				for (int y = 0; y < CY; y++) {
-					if (this->isblocked(x, y, z, x, y, z - 1)) {
-						continue;
-					}
-
-					const uint8_t type = this->_blk[x][y][z];
-					uint8_t top = type;
-					uint8_t bottom = type;
-					uint8_t side = type;
+		for (size_t v = 0; v < this->_visits.size(); v++) {
+			const visit current = this->_visits[v];
+			const chunk* c = this->_world.at(current.index);
 
-					if (top == 3) {
-						bottom = 1;
-						side = 2;
-					} else if (top == 5) {
-						top = bottom = 12;
-					}
-
-					vertex[i + 0] = glm::i8vec3(x, y, z);
-					vertex[i + 1] = glm::i8vec3(x, y + 1, z);
-					vertex[i + 2] = glm::i8vec3(x + 1, y, z);
-					vertex[i + 3] = glm::i8vec3(x, y + 1, z);
-					vertex[i + 4] = glm::i8vec3(x + 1, y + 1, z);
-					vertex[i + 5] = glm::i8vec3(x + 1, y, z);
-
-					normal[i + 0] = glm::i8vec3(0, 0, -1);
-					normal[i + 1] = glm::i8vec3(0, 0, -1);
-					normal[i + 2] = glm::i8vec3(0, 0, -1);
-					normal[i + 3] = glm::i8vec3(0, 0, -1);
-					normal[i + 4] = glm::i8vec3(0, 0, -1);
-					normal[i + 5] = glm::i8vec3(0, 0, -1);
-
-					uv[i + 0] = TYPE_TO_UV(side, 0.0f, 0.0f);
-					uv[i + 1] = TYPE_TO_UV(side, 0.0f, 1.0f);
-					uv[i + 2] = TYPE_TO_UV(side, 1.0f, 0.0f);
-					uv[i + 3] = TYPE_TO_UV(side, 0.0f, 1.0f);
-					uv[i + 4] = TYPE_TO_UV(side, 1.0f, 1.0f);
-					uv[i + 5] = TYPE_TO_UV(side, 1.0f, 0.0f);
-
-					i += 6;
+			for (int face = 0; face < chunk::face_count; face++) {
+				if (current.from >= 0 && !(c->_connectivity[current.from] & (1 << face))) {
+					continue;
 				}
-			}
-		}
 
-		// View from positive z
+				if (current.directions & (1 << (face ^ 1))) {
+					continue;
+				}
 
-		for (int x = 0; x < CX; x++) {
-			for (int z = 0; z < CZ; z++) {
-				for (int y = 0; y < CY; y++) {
-					if (this->isblocked(x, y, z, x, y, z + 1)) {
-						continue;
-					}
+				const chunk* n = c->neighbour(face);
 
-					const uint8_t type = this->_blk[x][y][z];
-					uint8_t top = type;
-					uint8_t bottom = type;
-					uint8_t side = type;
+				if (!n) {
+					continue;
+				}
 
-					if (top == 3) {
-						bottom = 1;
-						side = 2;
-					} else if (top == 5) {
-						top = bottom = 12;
-					}
+				const int i = this->_world.index(n);
 
-					vertex[i + 0] = glm::i8vec3(x, y, z + 1);
-					vertex[i + 1] = glm::i8vec3(x + 1, y, z + 1);
-					vertex[i + 2] = glm::i8vec3(x, y + 1, z + 1);
-					vertex[i + 3] = glm::i8vec3(x, y + 1, z + 1);
-					vertex[i + 4] = glm::i8vec3(x + 1, y, z + 1);
-					vertex[i + 5] = glm::i8vec3(x + 1, y + 1, z + 1);
-
-					normal[i + 0] = glm::i8vec3(0, 0, 1);
-					normal[i + 1] = glm::i8vec3(0, 0, 1);
-					normal[i + 2] = glm::i8vec3(0, 0, 1);
-					normal[i + 3] = glm::i8vec3(0, 0, 1);
-					normal[i + 4] = glm::i8vec3(0, 0, 1);
-					normal[i + 5] = glm::i8vec3(0, 0, 1);
-
-					uv[i + 0] = TYPE_TO_UV(side, 0.0f, 0.0f);
-					uv[i + 1] = TYPE_TO_UV(side, 1.0f, 0.0f);
-					uv[i + 2] = TYPE_TO_UV(side, 0.0f, 1.0f);
-					uv[i + 3] = TYPE_TO_UV(side, 0.0f, 1.0f);
-					uv[i + 4] = TYPE_TO_UV(side, 1.0f, 0.0f);
-					uv[i + 5] = TYPE_TO_UV(side, 1.0f, 1.0f);
-
-					i += 6;
+				if (this->_reachable_frame[i] == this->_frame || !f.test(glm::vec3(this->_minx[i], this->_miny[i], this->_minz[i]), glm::vec3(this->_maxx[i], this->_maxy[i], this->_maxz[i]))) {
+					continue;
 				}
+
+				this->_reachable_frame[i] = this->_frame;
+				this->_visits.push_back({ i, face ^ 1, uint8_t(current.directions | (1 << face)) });
 			}
 		}
+	}
 
-		this->_changed = false;
-		this->_elements = i;
+	// What the mesh takes up in the arena, including the rounding of its allocation
+	size_t mesh_bytes(int i) const {
+		const chunk_mesh& m = this->_meshes[i];
+		return m.first >= 0 ? this->_arena.size(m.first) * 3 * sizeof(glm::i8vec3) : 0;
+	}
 
-		if (this->_elements) {
-			glBindVertexArray(this->_vao);
+	// Moves the mesh built by chunk::mesh() into the arena
+	void upload(chunk* c) {
+		const int index = this->_world.index(c);
+		chunk_mesh& m = this->_meshes[index];
+		const size_t i = c->_mesh_vertex.size();
 
+		this->_mesh_bytes -= this->mesh_bytes(index);
 
-			glBindBuffer(GL_ARRAY_BUFFER, this->_vbo[0]);
-			glBufferData(GL_ARRAY_BUFFER, i * sizeof(vertex[0]), vertex, GL_STATIC_DRAW);
+		c->_meshed = false;
+		m.elements = i;
 
-			glEnableVertexAttribArray(cube_attribute_coord);
-			glVertexAttribPointer(cube_attribute_coord, 3, GL_BYTE, GL_FALSE, 0, 0);
+		if (m.first >= 0) {
+			this->_arena.release(m.first);
+			m.first = -1;
+		}
 
+		if (m.elements) {
+			m.first = this->_arena.allocate(i);
+			this->_arena.upload(m.first, c->_mesh_vertex.data(), c->_mesh_normal.data(), c->_mesh_uv.data(), i, glm::ivec3(c->_ax * CX, c->_ay * CY, c->_az * CZ));
+		}
 
-			glBindBuffer(GL_ARRAY_BUFFER, this->_vbo[1]);
-			glBufferData(GL_ARRAY_BUFFER, i * sizeof(normal[0]), normal, GL_STATIC_DRAW);
+		this->_mesh_bytes += this->mesh_bytes(index);
 
-			glEnableVertexAttribArray(cube_attribute_normal);
-			glVertexAttribPointer(cube_attribute_normal, 3, GL_BYTE, GL_FALSE, 0, 0);
+		// The mesh lives on the GPU now
+		std::vector<glm::i8vec3>().swap(c->_mesh_vertex);
+		std::vector<glm::i8vec3>().swap(c->_mesh_normal);
+		std::vector<glm::i8vec3>().swap(c->_mesh_uv);
 
+		// Occluders must match what's drawn, so they are updated together with the mesh
+		c->occluders(m.solid);
+	}
 
-			glBindBuffer(GL_ARRAY_BUFFER, this->_vbo[2]);
-			glBufferData(GL_ARRAY_BUFFER, i * sizeof(uv[0]), uv, GL_STATIC_DRAW);
+	// Frees the mesh of the chunk, it's rebuilt the next time the chunk is scheduled
+	void evict(chunk* c) {
+		const int index = this->_world.index(c);
+		chunk_mesh& m = this->_meshes[index];
 
-			glEnableVertexAttribArray(cube_attribute_uv);
-			glVertexAttribPointer(cube_attribute_uv, 3, GL_BYTE, GL_FALSE, 0, 0);
+		this->_mesh_bytes -= this->mesh_bytes(index);
+
+		if (m.first >= 0) {
+			this->_arena.release(m.first);
+			m.first = -1;
 		}
 
-		delete[] vertex;
-		delete[] normal;
-		delete[] uv;
+		m.elements = 0;
+		c->_changed = true;
 	}
 
-	void render() {
-		if (this->_changed) {
-			update();
+	// Queues the next step of preparing the chunk for drawing, if any
+	void schedule(chunk* c, float priority) {
+		if (!c->_initialized) {
+			this->_scheduler.push(scheduler::stage_generate, priority, [this, c]() {
+				PROFILE_SCOPE(phase_generate);
+				TRACE_SCOPE("generate");
+				this->_world.generate(c);
+			});
+		} else if (c->_changed) {
+			this->_scheduler.push(scheduler::stage_mesh, priority, [this, c]() {
+				PROFILE_SCOPE(phase_mesh);
+				TRACE_SCOPE("mesh");
+				c->mesh();
+				this->touch(c, 0);
+			});
+		} else if (c->_meshed) {
+			this->_scheduler.push(scheduler::stage_upload, priority, [this, c]() {
+				PROFILE_SCOPE(phase_upload);
+				TRACE_SCOPE("upload");
+				this->upload(c);
+				this->touch(c, 0);
+			});
 		}
+	}
 
-		if (this->_elements) {
-			glBindVertexArray(this->_vao);
-			glDrawArrays(GL_TRIANGLES, 0, this->_elements);
+	// Frees the meshes which weren't drawn for the longest time until the budget is met again.
+	// Only chunks which are done streaming are evicted, so they are remeshed once they are visible again.
+	void evict() {
+		if (this->_mesh_bytes <= this->_mesh_budget) {
+			return;
 		}
-	}
-};
 
-struct superchunk {
-	chunk* _c[SCX][SCY][SCZ];
-	unsigned int _seed;
+		this->_evictable.clear();
 
-	superchunk() {
-		this->_seed = (unsigned int)time(NULL);
+		for (int i = 0; i < SCX * SCY * SCZ; i++) {
+			const chunk_mesh& m = this->_meshes[i];
 
-		for (int x = 0; x < SCX; x++) {
-			for (int y = 0; y < SCY; y++) {
-				for (int z = 0; z < SCZ; z++) {
-					this->_c[x][y][z] = new chunk(x - SCX / 2, y - SCY / 2, z - SCZ / 2);
-				}
+			if (m.first >= 0 && m.streamed && !this->_world.at(i)->_meshed && m.drawn_frame != this->_frame) {
+				this->_evictable.push_back(i);
 			}
 		}
 
-		for (int x = 0; x < SCX; x++) {
-			for (int y = 0; y < SCY; y++) {
-				for (int z = 0; z < SCZ; z++) {
-					if (x > 0) {
-						this->_c[x][y][z]->_left = this->_c[x - 1][y][z];
-					}
-
-					if (x < SCX - 1) {
-						this->_c[x][y][z]->_right = this->_c[x + 1][y][z];
-					}
-
-					if (y > 0) {
-						this->_c[x][y][z]->_below = this->_c[x][y - 1][z];
-					}
+		std::sort(this->_evictable.begin(), this->_evictable.end(), [this](int a, int b) {
+			return this->_meshes[a].drawn_frame < this->_meshes[b].drawn_frame;
+		});
 
-					if (y < SCY - 1) {
-						this->_c[x][y][z]->_above = this->_c[x][y + 1][z];
-					}
+		for (int i : this->_evictable) {
+			if (this->_mesh_bytes <= this->_mesh_budget) {
+				break;
+			}
 
-					if (z > 0) {
-						this->_c[x][y][z]->_front = this->_c[x][y][z - 1];
-					}
+			chunk* c = this->_world.at(i);
 
-					if (z < SCZ - 1) {
-						this->_c[x][y][z]->_back = this->_c[x][y][z + 1];
-					}
-				}
-			}
+			this->evict(c);
+			this->touch(c, 0);
+			this->_evicted++;
 		}
 	}
 
-	uint8_t get(int x, int y, int z) const {
-		int cx = (x + CX * (SCX / 2)) / CX;
-		int cy = (y + CY * (SCY / 2)) / CY;
-		int cz = (z + CZ * (SCZ / 2)) / CZ;
+	// Culls the chunks and collects the vertex ranges of the ones left into _draw_first and _draw_count
+	void collect(const glm::mat4& v, const glm::mat4& p, const glm::vec3& camera) {
+		PROFILE_SCOPE(phase_culling);
 
-		if (cx < 0 || cx >= SCX || cy < 0 || cy >= SCY || cz <= 0 || cz >= SCZ) {
-			return 0;
-		}
+		this->refresh_columns();
 
-		return this->_c[cx][cy][cz]->get(x & (CX - 1), y & (CY - 1), z & (CZ - 1));
-	}
+		const frustum f(p * v);
 
-	void set(int x, int y, int z, uint8_t type) {
-		int cx = (x + CX * (SCX / 2)) / CX;
-		int cy = (y + CY * (SCY / 2)) / CY;
-		int cz = (z + CZ * (SCZ / 2)) / CZ;
+		this->_drawlist.clear();
+		this->cull(f, camera, 0);
 
-		if (cx < 0 || cx >= SCX || cy < 0 || cy >= SCY || cz <= 0 || cz >= SCZ) {
-			return;
+		// Leave out whatever can't be seen through open space from the camera
+		this->_unreachable = 0;
+
+		if (this->_cave_culling) {
+			this->reach(f, camera);
+
+			size_t n = 0;
+
+			for (int i : this->_drawlist) {
+				if (this->_reachable_frame[i] == this->_frame) {
+					this->_drawlist[n++] = i;
+				}
+			}
+
+			this->_unreachable = this->_drawlist.size() - n;
+			this->_drawlist.resize(n);
 		}
 
-		this->_c[cx][cy][cz]->set(x & (CX - 1), y & (CY - 1), z & (CZ - 1), type);
-	}
+		this->sort(camera);
 
-	void render(const glm::mat4& v, const glm::mat4& p) {
-		float ud = std::numeric_limits<float>::infinity();
-		int ux = -1;
-		int uy = -1;
-		int uz = -1;
+		// Chunks are streamed in closest first, but chunks off the screen
+		// are only prepared once everything on the screen is done.
+		for (size_t i = 0; i < this->_streaming.size();) {
+			chunk* c = this->_streaming[i];
+			const int j = this->_world.index(c);
 
-		for (int x = 0; x < SCX; x++) {
-			for (int y = 0; y < SCY; y++) {
-				for (int z = 0; z < SCZ; z++) {
-					glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(this->_c[x][y][z]->_ax * CX, this->_c[x][y][z]->_ay * CY, this->_c[x][y][z]->_az * CZ));
-					glm::mat3 normalMatrix = glm::inverseTranspose(glm::mat3(m));
+			if (c->_initialized && !c->_changed && !c->_meshed) {
+				this->_meshes[j].streamed = true;
+				this->touch(c, 0);
 
-					// Is this chunk on the screen?
-					glm::vec4 center = p * v * m * glm::vec4(CX / 2, CY / 2, CZ / 2, 1);
+				this->_streaming[i] = this->_streaming.back();
+				this->_streaming.pop_back();
+				continue;
+			}
 
-					float d = glm::length(center);
-					center.x /= center.w;
-					center.y /= center.w;
+			const glm::vec3 center(this->_minx[j] + CX / 2, this->_miny[j] + CY / 2, this->_minz[j] + CZ / 2);
+			const float d = glm::length(center - camera);
 
-					// If it is behind the camera, don't bother drawing it
-					if (center.z < -CY / 2) {
-						continue;
-					}
+			this->schedule(c, this->_visible_frame[j] == this->_frame ? d : d + SCX * CX);
+			i++;
+		}
 
-					// If it is outside the screen, don't bother drawing it
-					if (fabsf(center.x) > 1 + fabsf(CY * 2 / center.w) || fabsf(center.y) > 1 + fabsf(CY * 2 / center.w)) {
-						continue;
-					}
+		// Rasterize the solid parts of the chunks close to the camera and skip everything hidden behind them
+		this->_occluded = 0;
 
-					// If this chunk is not initialized, skip it
-					if (!this->_c[x][y][z]->_initialized) {
-						// But if it is the closest to the camera, mark it for initialization
-						if (ux < 0 || d < ud) {
-							ud = d;
-							ux = x;
-							uy = y;
-							uz = z;
-						}
+		if (this->_occlusion_culling) {
+			this->_occlusion.clear(p * v);
 
-						continue;
-					}
+			for (int i : this->_drawlist) {
+				const chunk_mesh& m = this->_meshes[i];
+				const glm::vec3 origin(this->_minx[i], this->_miny[i], this->_minz[i]);
 
-					glUniformMatrix4fv(cube_uniform_m, 1, GL_FALSE, glm::value_ptr(m));
-					glUniformMatrix3fv(cube_uniform_normalMatrix, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+				if (!m.elements || distance_to_box(camera, origin, origin + glm::vec3(CX, CY, CZ)) > OCCLUDER_DISTANCE) {
+					continue;
+				}
 
-					this->_c[x][y][z]->render();
+				for (int cx = 0; cx < CX / 4; cx++) {
+					for (int cz = 0; cz < CZ / 4; cz++) {
+						if (m.solid[cx][cz]) {
+							this->_occlusion.add_occluder(origin + glm::vec3(cx * 4, 0, cz * 4), origin + glm::vec3(cx * 4 + 4, m.solid[cx][cz], cz * 4 + 4));
+						}
+					}
 				}
 			}
 		}
 
-		if (ux >= 0) {
-			this->_c[ux][uy][uz]->noise(this->_seed);
+		this->_draw_first.clear();
+		this->_draw_count.clear();
 
-			if (this->_c[ux][uy][uz]->_left) {
-				this->_c[ux][uy][uz]->_left->noise(this->_seed);
-			}
+		for (int i : this->_drawlist) {
+			chunk_mesh& m = this->_meshes[i];
+			const glm::vec3 origin(this->_minx[i], this->_miny[i], this->_minz[i]);
 
-			if (this->_c[ux][uy][uz]->_right) {
-				this->_c[ux][uy][uz]->_right->noise(this->_seed);
+			if (this->_occlusion_culling && this->_occlusion.occluded(origin, origin + glm::vec3(CX, CY, CZ))) {
+				this->_occluded++;
+				continue;
 			}
 
-			if (this->_c[ux][uy][uz]->_below) {
-				this->_c[ux][uy][uz]->_below->noise(this->_seed);
+			// Chunks which were modified after streaming them in are remeshed once they are visible
+			if (m.streamed) {
+				this->schedule(this->_world.at(i), glm::length(origin + glm::vec3(CX / 2, CY / 2, CZ / 2) - camera));
 			}
 
-			if (this->_c[ux][uy][uz]->_above) {
-				this->_c[ux][uy][uz]->_above->noise(this->_seed);
+			if (m.elements) {
+				this->_draw_first.push_back(m.first);
+				this->_draw_count.push_back(m.elements);
+				m.drawn_frame = this->_frame;
 			}
+		}
+	}
 
-			if (this->_c[ux][uy][uz]->_front) {
-				this->_c[ux][uy][uz]->_front->noise(this->_seed);
-			}
+	void render(const glm::mat4& v, const glm::mat4& p, const glm::vec3& camera) {
+		this->_frame++;
+		this->collect(v, p, camera);
+
+		{
+			PROFILE_SCOPE(phase_draw);
+			PROFILE_GPU_SCOPE(phase_gpu_chunks);
+
+			// The GPU finishes queries in order, so the first one which isn't done ends the search
+			while (this->_samples_read != this->_samples_issued) {
+				const GLuint query = this->_samples_query[this->_samples_read % samples_queries];
+				GLint available = 0;
+
+				glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
 
-			if (this->_c[ux][uy][uz]->_back) {
-				this->_c[ux][uy][uz]->_back->noise(this->_seed);
+				if (!available) {
+					break;
+				}
+
+				glGetQueryObjectui64v(query, GL_QUERY_RESULT, &this->_samples);
+				this->_samples_read++;
 			}
 
-			this->_c[ux][uy][uz]->_initialized = true;
+			if (this->_samples_issued - this->_samples_read < samples_queries) {
+				glBeginQuery(GL_SAMPLES_PASSED, this->_samples_query[this->_samples_issued++ % samples_queries]);
+				this->_arena.draw(this->_draw_first, this->_draw_count);
+				glEndQuery(GL_SAMPLES_PASSED);
+			} else {
+				this->_arena.draw(this->_draw_first, this->_draw_count);
+			}
 		}
+
+		this->_scheduler.run();
+		this->evict();
+
+		// Give the memory freed by eviction back, this only does something once the arena is mostly empty
+		this->_arena.shrink([this](GLint from, GLint to) {
+			for (chunk_mesh& m : this->_meshes) {
+				if (m.first == from) {
+					m.first = to;
+					break;
+				}
+			}
+		});
 	}
 };
 
 static superchunk* world;
+static world_renderer* renderer;
 
 // Calculate the forward, right and lookat vectors from the angle vector
 static void update_vectors() {
@@ -862,60 +833,81 @@ static void update_vectors() {
 	up = glm::cross(right, lookat);
 }
 
+// Stops recording the trace and writes it to TRACE_PATH
+static void write_trace() {
+	trace_recorder& recorder = trace_recorder::instance();
+	recorder.stop();
+
+	try {
+		recorder.write(TRACE_PATH);
+		std::cout << "trace: " << recorder.events() << " events written to " << TRACE_PATH << ", " << recorder.dropped() << " dropped" << std::endl;
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+	}
+}
+
+#ifdef GLCRAFT_PROFILE
+// Writes the frame profile to PROFILE_PATH, failing to do so isn't worth aborting for
+static void write_profile() {
+	try {
+		profiler::instance().write_csv(PROFILE_PATH);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+	}
+}
+#endif
+
+
+// Connects the shared uniform blocks a program uses to their binding points and returns how many it uses
+static int bind_uniform_blocks(GLuint program) {
+	static const char* const names[] = { "frame", "material" };
+	static const uniform_binding bindings[] = { uniform_binding_frame, uniform_binding_material };
+
+	int blocks = 0;
+
+	for (int i = 0; i < 2; i++) {
+		const GLuint index = glGetUniformBlockIndex(program, names[i]);
+
+		if (index != GL_INVALID_INDEX) {
+			glUniformBlockBinding(program, index, bindings[i]);
+			blocks++;
+		}
+	}
+
+	return blocks;
+}
 
 static int init_resources() {
-	// Create shaders
-	cube_program = gl_service::program_from_file("assets/shaders/cube.vs", "assets/shaders/cube.fs");
-	white_program = gl_service::program_from_file("assets/shaders/white.vs", "assets/shaders/white.fs");
+	// Create shaders, the light is a spotlight attached to the camera
+	programs = new program_cache(PROGRAM_CACHE_PATH);
+	cube_variants = new shader_variants("assets/shaders/cube.vs", "assets/shaders/cube.fs", { "LIGHT_SPOT" }, programs);
+
+	cube_program = cube_variants->program(cube_light_spot);
+	white_program = programs->program_from_file("assets/shaders/white.vs", "assets/shaders/white.fs");
 
 	if (cube_program == 0 || white_program == 0) {
 		return 1;
 	}
 
-	cube_uniform_m                          = glGetUniformLocation(cube_program, "m");
-	cube_uniform_v                          = glGetUniformLocation(cube_program, "v");
-	cube_uniform_p                          = glGetUniformLocation(cube_program, "p");
-	cube_uniform_normalMatrix               = glGetUniformLocation(cube_program, "normalMatrix");
-	cube_uniform_cameraPosition             = glGetUniformLocation(cube_program, "cameraPosition");
-	cube_uniform_lightPosition              = glGetUniformLocation(cube_program, "lightPosition");
-	cube_uniform_lightDirection             = glGetUniformLocation(cube_program, "lightDirection");
-	cube_uniform_lightAmbientIntensity      = glGetUniformLocation(cube_program, "lightAmbientIntensity");
-	cube_uniform_lightDiffuseIntensity      = glGetUniformLocation(cube_program, "lightDiffuseIntensity");
-	cube_uniform_lightSpecularIntensity     = glGetUniformLocation(cube_program, "lightSpecularIntensity");
-	cube_uniform_lightSpotAttenuationStatic = glGetUniformLocation(cube_program, "lightSpotAttenuationStatic");
-	cube_uniform_lightSpotAttenuationLinear = glGetUniformLocation(cube_program, "lightSpotAttenuationLinear");
-	cube_uniform_lightSpotAttenuationCubic  = glGetUniformLocation(cube_program, "lightSpotAttenuationCubic");
-	cube_uniform_lightSpotExponent          = glGetUniformLocation(cube_program, "lightSpotExponent");
-	cube_uniform_lightSpotOffset            = glGetUniformLocation(cube_program, "lightSpotOffset");
-	cube_uniform_matAmbientReflectance      = glGetUniformLocation(cube_program, "matAmbientReflectance");
-	cube_uniform_matDiffuseReflectance      = glGetUniformLocation(cube_program, "matDiffuseReflectance");
-	cube_uniform_matSpecularReflectance     = glGetUniformLocation(cube_program, "matSpecularReflectance");
-	cube_uniform_matShininess               = glGetUniformLocation(cube_program, "matShininess");
+	const program_cache::stats& program_stats = programs->statistics();
+	std::cout << "programs: " << program_stats.hits + program_stats.misses << " in " << program_stats.seconds * 1000.0 << " ms, " << program_stats.hits << " cached" << (programs->supported() ? "" : " (binaries unsupported)") << std::endl;
+
+	// Not being able to write the cache only makes the next start slower
+	try {
+		programs->save();
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+	}
+
 	cube_uniform_diffuseTexture             = glGetUniformLocation(cube_program, "diffuseTexture");
+	cube_uniform_origins                    = glGetUniformLocation(cube_program, "origins");
 	cube_attribute_coord                    = glGetAttribLocation(cube_program, "v_coord");
 	cube_attribute_normal                   = glGetAttribLocation(cube_program, "v_normal");
 	cube_attribute_uv                       = glGetAttribLocation(cube_program, "v_uv");
 
-	if (   cube_uniform_m == -1
-	    || cube_uniform_v == -1
-	    || cube_uniform_p == -1
-	    || cube_uniform_normalMatrix == -1
-	    || cube_uniform_cameraPosition == -1
-	    || cube_uniform_lightPosition == -1
-	    || cube_uniform_lightDirection == -1
-	    || cube_uniform_lightAmbientIntensity == -1
-	    || cube_uniform_lightDiffuseIntensity == -1
-	    || cube_uniform_lightSpecularIntensity == -1
-	    || cube_uniform_lightSpotAttenuationStatic == -1
-	    || cube_uniform_lightSpotAttenuationLinear == -1
-	    || cube_uniform_lightSpotAttenuationCubic == -1
-	    || cube_uniform_lightSpotExponent == -1
-	    || cube_uniform_lightSpotOffset == -1
-	    || cube_uniform_matAmbientReflectance == -1
-	    || cube_uniform_matDiffuseReflectance == -1
-	    || cube_uniform_matSpecularReflectance == -1
-	    || cube_uniform_matShininess == -1
+	if (   bind_uniform_blocks(cube_program) != 2
 	    || cube_uniform_diffuseTexture == -1
+	    || cube_uniform_origins == -1
 	    || cube_attribute_coord == -1
 	    || cube_attribute_normal == -1
 		|| cube_attribute_uv == -1)
@@ -923,19 +915,36 @@ static int init_resources() {
 		return 2;
 	}
 
-	glUseProgram(cube_program);
-	glUniform3fv(cube_uniform_lightAmbientIntensity, 1, glm::value_ptr(glm::vec3(0.1f, 0.1f, 0.1f)));
-	glUniform3fv(cube_uniform_lightDiffuseIntensity, 1, glm::value_ptr(glm::vec3(0.8f, 0.8f, 0.6f)));
-	glUniform3fv(cube_uniform_lightSpecularIntensity, 1, glm::value_ptr(glm::vec3(0.4f, 0.4f, 0.4f)));
-	glUniform1f(cube_uniform_lightSpotAttenuationStatic, 0.2f);
-	glUniform1f(cube_uniform_lightSpotAttenuationLinear, 0.0f);
-	glUniform1f(cube_uniform_lightSpotAttenuationCubic, 0.005f);
-	glUniform1f(cube_uniform_lightSpotExponent, 20.0f);
-	glUniform1f(cube_uniform_lightSpotOffset, 0.0f);
-	glUniform3fv(cube_uniform_matAmbientReflectance, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 1.0f)));
-	glUniform3fv(cube_uniform_matDiffuseReflectance, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 1.0f)));
-	glUniform3fv(cube_uniform_matSpecularReflectance, 1, glm::value_ptr(glm::vec3(1.0f, 1.0f, 1.0f)));
-	glUniform1f(cube_uniform_matShininess, 1.0f);
+	bind_uniform_blocks(white_program);
+
+	gl_state& state = gl_service::state();
+
+	state.use_program(cube_program);
+	glUniform1i(cube_uniform_diffuseTexture, /*GL_TEXTURE*/0);
+	glUniform1i(cube_uniform_origins, /*GL_TEXTURE*/1);
+
+	// Only the camera and the light move, everything else in the frame block stays the same
+	frame_data.lightAmbientIntensity      = glm::vec3(0.1f, 0.1f, 0.1f);
+	frame_data.lightDiffuseIntensity      = glm::vec3(0.8f, 0.8f, 0.6f);
+	frame_data.lightSpecularIntensity     = glm::vec3(0.4f, 0.4f, 0.4f);
+	frame_data.lightSpotAttenuationStatic = 0.2f;
+	frame_data.lightSpotAttenuationLinear = 0.0f;
+	frame_data.lightSpotAttenuationCubic  = 0.005f;
+	frame_data.lightSpotExponent          = 20.0f;
+	frame_data.lightSpotOffset            = 0.0f;
+
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniform_alignment);
+
+	material_uniforms material = {};
+	material.matAmbientReflectance  = glm::vec3(1.0f, 1.0f, 1.0f);
+	material.matDiffuseReflectance  = glm::vec3(1.0f, 1.0f, 1.0f);
+	material.matSpecularReflectance = glm::vec3(1.0f, 1.0f, 1.0f);
+	material.matShininess           = 1.0f;
+
+	glGenBuffers(1, &material_ubo);
+	glBindBuffer(GL_UNIFORM_BUFFER, material_ubo);
+	gl_service::counters().buffer_data(GL_UNIFORM_BUFFER, sizeof(material), &material, GL_STATIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, uniform_binding_material, material_ubo);
 
 
 	// Create and upload the texture
@@ -958,7 +967,7 @@ static int init_resources() {
 	const unsigned long layers = imageHeight / imageWidth;
 
 	glGenTextures(1, &textures);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, textures);
+	state.bind_texture(0, GL_TEXTURE_2D_ARRAY, textures);
 
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
@@ -972,15 +981,28 @@ static int init_resources() {
 	}
 
 
-	world = new superchunk;
+	world = new superchunk((unsigned int)time(NULL));
+	renderer = new world_renderer(*world);
 
 	position = glm::vec3(0, SEALEVEL + 10, 0);
 	angle = glm::vec3(0, -0.5, 0);
 	update_vectors();
 
 
+	dynamic_data = new stream_buffer(DYNAMIC_DATA_SIZE);
+
 	glGenVertexArrays(1, &box_vao);
-	glGenBuffers(1, &box_vbo);
+
+	// The box is drawn in world coordinates, so the origin table for it is just zero
+	const int16_t zero[4] = { 0, 0, 0, 0 };
+
+	glGenBuffers(1, &box_origins);
+	glBindBuffer(GL_TEXTURE_BUFFER, box_origins);
+	gl_service::counters().buffer_data(GL_TEXTURE_BUFFER, sizeof(zero), zero, GL_STATIC_DRAW);
+
+	glGenTextures(1, &box_origin_texture);
+	state.bind_texture(1, GL_TEXTURE_BUFFER, box_origin_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA16I, box_origins);
 
 	// Create a VBO for the cursor
 	float cross[4][2] = {
@@ -989,11 +1011,11 @@ static int init_resources() {
 	};
 
 	glGenVertexArrays(1, &cursor_vao);
-	glBindVertexArray(cursor_vao);
+	state.bind_vertex_array(cursor_vao);
 
 	glGenBuffers(1, &cursor_vbo);
 	glBindBuffer(GL_ARRAY_BUFFER, cursor_vbo);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(cross), cross, GL_STATIC_DRAW);
+	gl_service::counters().buffer_data(GL_ARRAY_BUFFER, sizeof(cross), cross, GL_STATIC_DRAW);
 
 	glEnableVertexAttribArray(0);
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
@@ -1001,22 +1023,42 @@ static int init_resources() {
 	return 0;
 }
 
-// Not really GLSL fract(), but the absolute distance to the nearest integer value
-static float fract(float value) {
-	float f = value - floorf(value);
-
-	if (f > 0.5f) {
-		return 1.0f - f;
-	} else {
-		return f;
-	}
+static void usage() {
+	std::cerr << "usage: glcraft [region] [-headless FRAMES] [-trace]" << std::endl;
+	std::cerr << "  -headless renders FRAMES frames without a window, FRAMES has to be positive." << std::endl;
 }
 
 int main(int argc, char* argv[]) {
 	srand(time(nullptr));
 
-	gl_service service("minecraft");
+	const char* region_path = nullptr;
+	bool headless = false;
+	unsigned int frames = 0;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-headless")) {
+			char* end = nullptr;
+			const long count = i + 1 < argc ? strtol(argv[i + 1], &end, 10) : 0;
+
+			// Without a frame limit run_headless() would never return
+			if (!end || *end || count <= 0 || count > long(std::numeric_limits<unsigned int>::max())) {
+				usage();
+				return 1;
+			}
+
+			headless = true;
+			frames = unsigned(count);
+			i++;
+		} else if (!strcmp(argv[i], "-trace")) {
+			trace_recorder::instance().start(size_t(TRACE_BUDGET_MB) << 20);
+		} else {
+			region_path = argv[i];
+		}
+	}
+
+	gl_service service("minecraft", headless ? gl_service::headless : gl_service::windowed);
 	service.set_cursor_disabled(true);
+	service.set_frame_limit(frames);
 
 	service.on_reshape([](int width, int height) {
 		ww = width;
@@ -1060,6 +1102,84 @@ int main(int argc, char* argv[]) {
 			angle = glm::vec3(0, -M_PIf / 2, 0);
 			update_vectors();
 			break;
+
+		case GLFW_KEY_F1: {
+			const worldgen::stats& stats = world->_gen.timings();
+
+			std::cout << "worldgen: " << stats.columns << " columns, " << stats.chunks << " chunks" << std::endl;
+			std::cout << "  heightmap:  " << stats.heightmap * 1000.0 << " ms" << std::endl;
+			std::cout << "  strata:     " << stats.strata * 1000.0 << " ms" << std::endl;
+			std::cout << "  fluids:     " << stats.fluids * 1000.0 << " ms" << std::endl;
+			std::cout << "  decoration: " << stats.decoration * 1000.0 << " ms" << std::endl;
+
+			std::cout << "culling: " << renderer->_drawlist.size() << " of " << SCX * SCY * SCZ << " chunks visible" << std::endl;
+			std::cout << "  unreachable: " << renderer->_unreachable << (renderer->_cave_culling ? "" : " (disabled)") << std::endl;
+			std::cout << "  occluded:   " << renderer->_occluded << (renderer->_occlusion_culling ? "" : " (disabled)") << std::endl;
+
+			std::cout << "gl state: " << gl_service::state().issued() << " calls, " << gl_service::state().suppressed() << " redundant ones filtered" << std::endl;
+
+			const gl_counters::frame& calls = gl_service::counters().last();
+			std::cout << "gl calls: " << calls.draw_calls << " draws, " << calls.triangles << " triangles, " << calls.upload_bytes / 1024 << " KiB uploaded last frame" << std::endl;
+			std::cout << "  binds:      " << calls.program_binds << " programs, " << calls.vertex_array_binds << " vertex arrays" << std::endl;
+			std::cout << "meshes: " << renderer->_arena.used() * 3 * sizeof(glm::i8vec3) / 1024 << " of " << renderer->_arena.capacity() * 3 * sizeof(glm::i8vec3) / 1024 << " KiB, " << renderer->_draw_first.size() << " chunks drawn" << std::endl;
+			std::cout << "  budget:     " << renderer->_mesh_bytes / 1024 << " of " << renderer->_mesh_budget / 1024 << " KiB, " << renderer->_evicted << " evicted" << std::endl;
+
+			static const char* const orders[] = { "front to back", "back to front", "unsorted" };
+
+			std::cout << "sorting: " << renderer->_sort_time * 1000.0 << " ms, " << orders[renderer->_order] << std::endl;
+			std::cout << "  fragments:  " << renderer->_samples << " passed the depth test" << std::endl;
+
+			const scheduler& sched = renderer->_scheduler;
+
+			std::cout << "streaming: " << sched.elapsed() * 1000.0 << " of " << sched.budget() << " ms last frame" << std::endl;
+			std::cout << "  upload:     " << sched.executed(scheduler::stage_upload) << " of " << sched.pending(scheduler::stage_upload) << std::endl;
+			std::cout << "  mesh:       " << sched.executed(scheduler::stage_mesh) << " of " << sched.pending(scheduler::stage_mesh) << std::endl;
+			std::cout << "  generate:   " << sched.executed(scheduler::stage_generate) << " of " << sched.pending(scheduler::stage_generate) << std::endl;
+			break;
+		}
+
+		case GLFW_KEY_F2:
+			renderer->_occlusion_culling = !renderer->_occlusion_culling;
+			break;
+
+		case GLFW_KEY_F3:
+			renderer->_cave_culling = !renderer->_cave_culling;
+			break;
+
+		case GLFW_KEY_F4:
+			renderer->_order = world_renderer::draw_order((renderer->_order + 1) % world_renderer::order_count);
+			break;
+
+#ifdef GLCRAFT_PROFILE
+		case GLFW_KEY_F5: {
+			const profiler& prof = profiler::instance();
+
+			std::cout << "profile: last " << prof.frames() << " frames, p50 / p95 / p99 / max in ms" << std::endl;
+
+			for (int i = 0; i < profiler::phase_count; i++) {
+				const profiler::summary s = prof.report(profiler::phase(i));
+				std::cout << "  " << profiler::name(profiler::phase(i)) << ": " << s.p50 * 1000.0 << " / " << s.p95 * 1000.0 << " / " << s.p99 * 1000.0 << " / " << s.max * 1000.0 << std::endl;
+			}
+
+			std::cout << "counters: per frame, p50 / p95 / p99 / max" << std::endl;
+
+			for (int i = 0; i < profiler::counter_count; i++) {
+				const profiler::summary s = prof.report(profiler::counter(i));
+				std::cout << "  " << profiler::name(profiler::counter(i)) << ": " << s.p50 << " / " << s.p95 << " / " << s.p99 << " / " << s.max << std::endl;
+			}
+
+			write_profile();
+			break;
+		}
+#endif
+
+		case GLFW_KEY_F6:
+			if (trace_recorder::instance().recording()) {
+				write_trace();
+			} else {
+				trace_recorder::instance().start(size_t(TRACE_BUDGET_MB) << 20);
+			}
+			break;
 		}
 	});
 
@@ -1092,6 +1212,10 @@ int main(int argc, char* argv[]) {
 	});
 
 	service.on_mousedown([](int button) {
+		if (!targeted) {
+			return;
+		}
+
 		if (button == 0) {
 			if (face == 0) {
 				mx++;
@@ -1192,144 +1316,119 @@ int main(int argc, char* argv[]) {
 		glClearColor(0.0f, 0.2f, 0.4f, 0.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_CULL_FACE);
-		glCullFace(GL_BACK);
+		gl_state& state = gl_service::state();
+
+		state.enable(GL_DEPTH_TEST);
+		state.enable(GL_CULL_FACE);
+		state.cull_face(GL_BACK);
 
-		glUseProgram(cube_program);
+		state.use_program(cube_program);
 
 		glm::mat4 v = glm::lookAt(position, position + lookat, up);
 		glm::mat4 p = glm::perspective(45.0f, float(ww) / float(wh), 0.01f, 1000.0f);
 
-		glUniformMatrix4fv(cube_uniform_v, 1, GL_FALSE, glm::value_ptr(v));
-		glUniformMatrix4fv(cube_uniform_p, 1, GL_FALSE, glm::value_ptr(p));
+		// The light is a spotlight attached to the camera
+		frame_data.v = v;
+		frame_data.p = p;
+		frame_data.cameraPosition = position;
+		frame_data.lightPosition = position;
+		frame_data.lightDirection = lookat;
 
-		glUniform3fv(cube_uniform_cameraPosition, 1, glm::value_ptr(position));
-		glUniform4fv(cube_uniform_lightPosition, 1, glm::value_ptr(glm::vec4(position, 0.0f)));
-		glUniform3fv(cube_uniform_lightDirection, 1, glm::value_ptr(lookat));
+		// One write for every program using the frame block
+		const size_t frame_offset = dynamic_data->write(&frame_data, sizeof(frame_data), size_t(uniform_alignment));
+		glBindBufferRange(GL_UNIFORM_BUFFER, uniform_binding_frame, dynamic_data->buffer(), GLintptr(frame_offset), sizeof(frame_data));
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D_ARRAY, textures);
-		glUniform1i(cube_uniform_diffuseTexture, /*GL_TEXTURE*/0);
+		state.bind_texture(0, GL_TEXTURE_2D_ARRAY, textures);
 
-		world->render(v, p);
+		renderer->render(v, p, position);
 
-		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		// Find the block we are pointing at
+		glm::ivec3 target;
 
-		// Find out coordinates of the center pixel
-		float depth;
-		glReadPixels(ww / 2, wh / 2, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &depth);
-
-		// Find out which block it belongs to
-		glm::vec4 viewport = glm::vec4(0, 0, ww, wh);
-		glm::vec3 wincoord = glm::vec3(ww / 2, wh / 2, depth);
-		glm::vec3 objcoord = glm::unProject(wincoord, v, p, viewport);
-
-		mx = int(objcoord.x);
-		my = int(objcoord.y);
-		mz = int(objcoord.z);
-
-		if (objcoord.x < 0) {
-			mx--;
+		{
+			PROFILE_SCOPE(phase_picking);
+			targeted = world->raycast(position, lookat, VIEW_DISTANCE, target, face);
 		}
 
-		if (objcoord.y < 0) {
-			my--;
-		}
+		// target is only set by a hit, otherwise the last targeted block stays as it was
+		if (targeted) {
+			mx = target.x;
+			my = target.y;
+			mz = target.z;
+
+			PROFILE_SCOPE(phase_draw);
+			PROFILE_GPU_SCOPE(phase_gpu_overlay);
+
+			const float mxf = float(mx);
+			const float myf = float(my);
+			const float mzf = float(mz);
+
+			// Render a box around the block we are pointing at.
+			float box[24][4] = {
+				{mxf + 0.0f, myf + 0.0f, mzf + 0.0f, 14},
+				{mxf + 1.0f, myf + 0.0f, mzf + 0.0f, 14},
+				{mxf + 0.0f, myf + 1.0f, mzf + 0.0f, 14},
+				{mxf + 1.0f, myf + 1.0f, mzf + 0.0f, 14},
+				{mxf + 0.0f, myf + 0.0f, mzf + 1.0f, 14},
+				{mxf + 1.0f, myf + 0.0f, mzf + 1.0f, 14},
+				{mxf + 0.0f, myf + 1.0f, mzf + 1.0f, 14},
+				{mxf + 1.0f, myf + 1.0f, mzf + 1.0f, 14},
+
+				{mxf + 0.0f, myf + 0.0f, mzf + 0.0f, 14},
+				{mxf + 0.0f, myf + 1.0f, mzf + 0.0f, 14},
+				{mxf + 1.0f, myf + 0.0f, mzf + 0.0f, 14},
+				{mxf + 1.0f, myf + 1.0f, mzf + 0.0f, 14},
+				{mxf + 0.0f, myf + 0.0f, mzf + 1.0f, 14},
+				{mxf + 0.0f, myf + 1.0f, mzf + 1.0f, 14},
+				{mxf + 1.0f, myf + 0.0f, mzf + 1.0f, 14},
+				{mxf + 1.0f, myf + 1.0f, mzf + 1.0f, 14},
+
+				{mxf + 0.0f, myf + 0.0f, mzf + 0.0f, 14},
+				{mxf + 0.0f, myf + 0.0f, mzf + 1.0f, 14},
+				{mxf + 1.0f, myf + 0.0f, mzf + 0.0f, 14},
+				{mxf + 1.0f, myf + 0.0f, mzf + 1.0f, 14},
+				{mxf + 0.0f, myf + 1.0f, mzf + 0.0f, 14},
+				{mxf + 0.0f, myf + 1.0f, mzf + 1.0f, 14},
+				{mxf + 1.0f, myf + 1.0f, mzf + 0.0f, 14},
+				{mxf + 1.0f, myf + 1.0f, mzf + 1.0f, 14},
+			};
+
+			state.disable(GL_CULL_FACE);
+
+			const size_t offset = dynamic_data->write(box, sizeof(box));
+
+			// Point the attribute at this frame's copy instead of passing a first vertex,
+			// since the shader looks up the origin by gl_VertexID.
+			state.bind_vertex_array(box_vao);
+			glBindBuffer(GL_ARRAY_BUFFER, dynamic_data->buffer());
 
-		if (objcoord.z < 0) {
-			mz--;
-		}
-
-		// Find out which face of the block we are looking at
-		if (fract(objcoord.x) < fract(objcoord.y)) {
-			if (fract(objcoord.x) < fract(objcoord.z)) {
-				mx--;
-				face = 0;    // X
-			} else {
-				face = 2;    // Z
-			}
-		} else if (fract(objcoord.y) < fract(objcoord.z)) {
-			face = 1;    // Y
-		} else {
-			face = 2;    // Z
-		}
+			glEnableVertexAttribArray(cube_attribute_coord);
+			glVertexAttribPointer(cube_attribute_coord, 4, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const void*>(offset));
 
-		if (face == 0 && lookat.x > 0) {
-			mx++;
-			face = 3;
-		}
+			state.bind_texture(1, GL_TEXTURE_BUFFER, box_origin_texture);
 
-		if (face == 1 && lookat.y > 0) {
-			my++;
-			face = 4;
+			gl_service::counters().draw_arrays(GL_LINES, 0, 24);
 		}
 
-		if (face == 2 && lookat.z > 0) {
-			mz++;
-			face = 5;
-		}
 
-		const float mxf = float(mx);
-		const float myf = float(my);
-		const float mzf = float(mz);
-
-		// Render a box around the block we are pointing at.
-		float box[24][4] = {
-			{mxf + 0.0f, myf + 0.0f, mzf + 0.0f, 14},
-			{mxf + 1.0f, myf + 0.0f, mzf + 0.0f, 14},
-			{mxf + 0.0f, myf + 1.0f, mzf + 0.0f, 14},
-			{mxf + 1.0f, myf + 1.0f, mzf + 0.0f, 14},
-			{mxf + 0.0f, myf + 0.0f, mzf + 1.0f, 14},
-			{mxf + 1.0f, myf + 0.0f, mzf + 1.0f, 14},
-			{mxf + 0.0f, myf + 1.0f, mzf + 1.0f, 14},
-			{mxf + 1.0f, myf + 1.0f, mzf + 1.0f, 14},
-
-			{mxf + 0.0f, myf + 0.0f, mzf + 0.0f, 14},
-			{mxf + 0.0f, myf + 1.0f, mzf + 0.0f, 14},
-			{mxf + 1.0f, myf + 0.0f, mzf + 0.0f, 14},
-			{mxf + 1.0f, myf + 1.0f, mzf + 0.0f, 14},
-			{mxf + 0.0f, myf + 0.0f, mzf + 1.0f, 14},
-			{mxf + 0.0f, myf + 1.0f, mzf + 1.0f, 14},
-			{mxf + 1.0f, myf + 0.0f, mzf + 1.0f, 14},
-			{mxf + 1.0f, myf + 1.0f, mzf + 1.0f, 14},
-
-			{mxf + 0.0f, myf + 0.0f, mzf + 0.0f, 14},
-			{mxf + 0.0f, myf + 0.0f, mzf + 1.0f, 14},
-			{mxf + 1.0f, myf + 0.0f, mzf + 0.0f, 14},
-			{mxf + 1.0f, myf + 0.0f, mzf + 1.0f, 14},
-			{mxf + 0.0f, myf + 1.0f, mzf + 0.0f, 14},
-			{mxf + 0.0f, myf + 1.0f, mzf + 1.0f, 14},
-			{mxf + 1.0f, myf + 1.0f, mzf + 0.0f, 14},
-			{mxf + 1.0f, myf + 1.0f, mzf + 1.0f, 14},
-		};
-
-		glDisable(GL_CULL_FACE);
-
-		glBindVertexArray(box_vao);
-
-		glBindBuffer(GL_ARRAY_BUFFER, box_vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(box), box, GL_STATIC_DRAW);
-
-		glEnableVertexAttribArray(cube_attribute_coord);
-		glVertexAttribPointer(cube_attribute_coord, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
-
-		glm::mat4 m = glm::mat4(1.0f);
-		glUniformMatrix4fv(cube_uniform_m, 1, GL_FALSE, glm::value_ptr(m));
-		glDrawArrays(GL_LINES, 0, 24);
+		// Draw a cross in the center of the screen
+		{
+			PROFILE_SCOPE(phase_draw);
+			PROFILE_GPU_SCOPE(phase_gpu_overlay);
 
+			state.use_program(white_program);
 
-		// Draw a cross in the center of the screen
-		glUseProgram(white_program);
+			state.disable(GL_DEPTH_TEST);
+			state.enable(GL_BLEND);
+			state.blend_func(GL_ONE_MINUS_DST_COLOR, GL_ZERO);
 
-		glDisable(GL_DEPTH_TEST);
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_ONE_MINUS_DST_COLOR, GL_ZERO);
+			state.bind_vertex_array(cursor_vao);
+			gl_service::counters().draw_arrays(GL_LINES, 0, 4);
 
-		glBindVertexArray(cursor_vao);
-		glDrawArrays(GL_LINES, 0, 4);
+			state.disable(GL_BLEND);
+		}
 
-		glDisable(GL_BLEND);
+		dynamic_data->end_frame();
 	});
 
 	try {
@@ -1337,12 +1436,32 @@ int main(int argc, char* argv[]) {
 		if (r) {
 			return r;
 		}
+
+		// Start with a world pre-generated by glcraft_pregen
+		if (region_path) {
+			world->load(region::load(region_path));
+		}
 	} catch (const std::exception& e) {
 		std::cerr << e.what() << std::endl;
 		return 127;
 	}
 
+	const auto start = std::chrono::steady_clock::now();
 	service.run();
+	const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+#ifdef GLCRAFT_PROFILE
+	write_profile();
+#endif
+
+	if (trace_recorder::instance().recording()) {
+		write_trace();
+	}
+
+	if (headless) {
+		std::cout << frames << " frames in " << elapsed << " s, " << elapsed * 1000.0 / frames << " ms per frame" << std::endl;
+	}
+
 	return 0;
 }
 
@@ -0,0 +1,258 @@
+#include "mesh_arena.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#include "gl_service.h"
+
+
+mesh_arena::mesh_arena(GLint coord, GLint normal, GLint uv, GLuint unit) : _vao(0), _vbo(), _origins(0), _origin_texture(0), _attributes{ coord, normal, uv }, _unit(unit), _order(initial_order), _free(initial_order + 1), _allocated(size_t(1) << initial_order, -1), _used(0) {
+	glGenVertexArrays(1, &this->_vao);
+	glGenTextures(1, &this->_origin_texture);
+
+	this->reallocate(0);
+	this->_free[this->_order].insert(0);
+}
+
+mesh_arena::~mesh_arena() {
+	glDeleteTextures(1, &this->_origin_texture);
+	glDeleteBuffers(1, &this->_origins);
+	glDeleteBuffers(3, this->_vbo);
+	glDeleteVertexArrays(1, &this->_vao);
+
+	// The names might be reused by new objects
+	gl_service::state().invalidate();
+}
+
+GLint mesh_arena::allocate(size_t count) {
+	const size_t blocks = std::max<size_t>((count + block_size - 1) / block_size, 1);
+	int order = 0;
+
+	while ((size_t(1) << order) < blocks) {
+		order++;
+	}
+
+	uint32_t block;
+
+	while (!this->take(order, std::numeric_limits<uint32_t>::max(), block)) {
+		this->grow();
+	}
+
+	return GLint(block * block_size);
+}
+
+void mesh_arena::release(GLint first) {
+	const uint32_t block = uint32_t(first / block_size);
+	const int order = this->_allocated[block];
+
+	this->_allocated[block] = -1;
+	this->_used -= size_t(block_size) << order;
+
+	this->insert_free(block, order);
+}
+
+size_t mesh_arena::size(GLint first) const {
+	return size_t(block_size) << this->_allocated[first / block_size];
+}
+
+void mesh_arena::shrink(const std::function<void(GLint, GLint)>& moved) {
+	// Only once a quarter is used, so that the arena doesn't shrink and grow back over and over
+	while (this->_order > initial_order && this->_used <= size_t(block_size) << (this->_order - 2)) {
+		const uint32_t half = uint32_t(1) << (this->_order - 1);
+
+		for (uint32_t from = half; from < 2 * half; from++) {
+			const int order = this->_allocated[from];
+			uint32_t to;
+
+			if (order < 0) {
+				continue;
+			}
+
+			// The lower half might be too fragmented, then the arena stays as it is for now
+			if (!this->take(order, half, to)) {
+				return;
+			}
+
+			const size_t blocks = size_t(1) << order;
+
+			for (int i = 0; i < 3; i++) {
+				glBindBuffer(GL_COPY_READ_BUFFER, this->_vbo[i]);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, this->_vbo[i]);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from * block_size * sizeof(glm::i8vec3), to * block_size * sizeof(glm::i8vec3), blocks * block_size * sizeof(glm::i8vec3));
+			}
+
+			glBindBuffer(GL_COPY_READ_BUFFER, this->_origins);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, this->_origins);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, from * 4 * sizeof(int16_t), to * 4 * sizeof(int16_t), blocks * 4 * sizeof(int16_t));
+
+			this->release(GLint(from * block_size));
+			moved(GLint(from * block_size), GLint(to * block_size));
+		}
+
+		// The upper half is free now, either on its own or merged with an empty lower half
+		if (this->_free[this->_order].erase(0)) {
+			this->_free[this->_order - 1].insert(0);
+		} else {
+			this->_free[this->_order - 1].erase(half);
+		}
+
+		this->_order--;
+		this->_free.resize(this->_order + 1);
+		this->_allocated.resize(half);
+
+		this->reallocate(half);
+	}
+}
+
+void mesh_arena::upload(GLint first, const glm::i8vec3* vertex, const glm::i8vec3* normal, const glm::i8vec3* uv, size_t count, const glm::ivec3& origin) {
+	const glm::i8vec3* data[3] = { vertex, normal, uv };
+
+	for (int i = 0; i < 3; i++) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, this->_vbo[i]);
+		gl_service::counters().buffer_sub_data(GL_COPY_WRITE_BUFFER, first * sizeof(glm::i8vec3), count * sizeof(glm::i8vec3), data[i]);
+	}
+
+	// Every block of the allocation gets the origin, since the shader only knows the block of a vertex
+	const uint32_t block = uint32_t(first / block_size);
+	const size_t blocks = size_t(1) << this->_allocated[block];
+	std::vector<int16_t> origins(blocks * 4);
+
+	for (size_t i = 0; i < blocks; i++) {
+		origins[i * 4 + 0] = int16_t(origin.x);
+		origins[i * 4 + 1] = int16_t(origin.y);
+		origins[i * 4 + 2] = int16_t(origin.z);
+		origins[i * 4 + 3] = 0;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, this->_origins);
+	gl_service::counters().buffer_sub_data(GL_COPY_WRITE_BUFFER, block * 4 * sizeof(int16_t), origins.size() * sizeof(int16_t), origins.data());
+}
+
+void mesh_arena::draw(const std::vector<GLint>& first, const std::vector<GLsizei>& count) const {
+	if (first.empty()) {
+		return;
+	}
+
+	gl_service::state().bind_texture(this->_unit, GL_TEXTURE_BUFFER, this->_origin_texture);
+	gl_service::state().bind_vertex_array(this->_vao);
+
+	gl_service::counters().multi_draw_arrays(GL_TRIANGLES, first.data(), count.data(), GLsizei(first.size()));
+}
+
+size_t mesh_arena::capacity() const {
+	return size_t(block_size) << this->_order;
+}
+
+size_t mesh_arena::used() const {
+	return this->_used;
+}
+
+// Allocates the first free block of the given order below limit, splitting a larger one if needed
+bool mesh_arena::take(int order, uint32_t limit, uint32_t& block) {
+	int o = order;
+
+	while (o <= this->_order && (this->_free[o].empty() || *this->_free[o].begin() >= limit)) {
+		o++;
+	}
+
+	if (o > this->_order) {
+		return false;
+	}
+
+	block = *this->_free[o].begin();
+	this->_free[o].erase(this->_free[o].begin());
+
+	// Split the block in halves until it fits, the upper halves stay free
+	while (o > order) {
+		o--;
+		this->_free[o].insert(block + (uint32_t(1) << o));
+	}
+
+	this->_allocated[block] = int8_t(order);
+	this->_used += size_t(block_size) << order;
+
+	return true;
+}
+
+// Doubles the arena, the new upper half becomes free
+void mesh_arena::grow() {
+	GLint max_texels = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &max_texels);
+
+	const size_t blocks = size_t(1) << this->_order;
+
+	if (blocks * 2 > size_t(max_texels)) {
+		throw std::runtime_error("mesh arena exceeds GL_MAX_TEXTURE_BUFFER_SIZE");
+	}
+
+	this->_order++;
+	this->_free.resize(this->_order + 1);
+	this->_allocated.resize(blocks * 2, -1);
+
+	this->reallocate(blocks);
+	this->insert_free(uint32_t(blocks), this->_order - 1);
+}
+
+// Creates buffers for the current capacity and copies over the given number of blocks from the old ones
+void mesh_arena::reallocate(size_t blocks) {
+	const size_t capacity = size_t(1) << this->_order;
+	GLuint vbo[3];
+	GLuint origins;
+
+	glGenBuffers(3, vbo);
+	glGenBuffers(1, &origins);
+
+	for (int i = 0; i < 3; i++) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vbo[i]);
+		glBufferData(GL_COPY_WRITE_BUFFER, capacity * block_size * sizeof(glm::i8vec3), nullptr, GL_STATIC_DRAW);
+
+		if (blocks) {
+			glBindBuffer(GL_COPY_READ_BUFFER, this->_vbo[i]);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, blocks * block_size * sizeof(glm::i8vec3));
+		}
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, origins);
+	glBufferData(GL_COPY_WRITE_BUFFER, capacity * 4 * sizeof(int16_t), nullptr, GL_STATIC_DRAW);
+
+	if (blocks) {
+		glBindBuffer(GL_COPY_READ_BUFFER, this->_origins);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, blocks * 4 * sizeof(int16_t));
+
+		glDeleteBuffers(3, this->_vbo);
+		glDeleteBuffers(1, &this->_origins);
+	}
+
+	std::copy(vbo, vbo + 3, this->_vbo);
+	this->_origins = origins;
+
+	gl_service::state().bind_vertex_array(this->_vao);
+
+	for (int i = 0; i < 3; i++) {
+		glBindBuffer(GL_ARRAY_BUFFER, this->_vbo[i]);
+		glEnableVertexAttribArray(this->_attributes[i]);
+		glVertexAttribPointer(this->_attributes[i], 3, GL_BYTE, GL_FALSE, 0, 0);
+	}
+
+	gl_service::state().bind_texture(this->_unit, GL_TEXTURE_BUFFER, this->_origin_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA16I, this->_origins);
+}
+
+// Returns the block to the free lists, merging it with its buddy as long as that is free too
+void mesh_arena::insert_free(uint32_t block, int order) {
+	while (order < this->_order) {
+		const uint32_t buddy = block ^ (uint32_t(1) << order);
+		const auto it = this->_free[order].find(buddy);
+
+		if (it == this->_free[order].end()) {
+			break;
+		}
+
+		this->_free[order].erase(it);
+		block = std::min(block, buddy);
+		order++;
+	}
+
+	this->_free[order].insert(block);
+}
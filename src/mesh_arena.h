@@ -0,0 +1,81 @@
+#ifndef mesh_arena_h
+#define mesh_arena_h
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+
+/*
+ * One set of vertex buffers shared by all chunk meshes, so that every visible chunk
+ * can be submitted with a single glMultiDrawArrays().
+ *
+ * Meshes are sub-allocated with a buddy allocator in blocks of block_size vertices,
+ * growing the buffers whenever they run full and shrinking them again once they are mostly empty. Since uniforms can't change in between
+ * the meshes of a multi-draw, the origin of each block is kept in a buffer texture,
+ * which the vertex shader looks up with gl_VertexID / block_size.
+ */
+class mesh_arena {
+public:
+	enum {
+		block_size = 64, // must match originBlockSize in cube.vs
+		initial_order = 14,
+	};
+
+	// Takes the attribute locations of the coordinates, normals and texture coordinates,
+	// and the texture unit to bind the origin table to.
+	mesh_arena(GLint coord, GLint normal, GLint uv, GLuint unit);
+	~mesh_arena();
+
+	mesh_arena(const mesh_arena&) = delete;
+	mesh_arena& operator=(const mesh_arena&) = delete;
+
+	// Returns the first vertex of a new allocation with room for the given number of vertices
+	GLint allocate(size_t count);
+	void release(GLint first);
+
+	// Vertices reserved for the allocation, i.e. its size rounded up to a power of two blocks
+	size_t size(GLint first) const;
+
+	/*
+	 * Halves the buffers as long as at most a quarter of them is used, moving the allocations from the upper half down.
+	 * moved(from, to) is called with the old and new first vertex of every moved allocation.
+	 */
+	void shrink(const std::function<void(GLint, GLint)>& moved);
+
+	void upload(GLint first, const glm::i8vec3* vertex, const glm::i8vec3* normal, const glm::i8vec3* uv, size_t count, const glm::ivec3& origin);
+
+	// Draws the given ranges of vertices as triangles
+	void draw(const std::vector<GLint>& first, const std::vector<GLsizei>& count) const;
+
+	// In vertices
+	size_t capacity() const;
+	size_t used() const;
+
+private:
+	bool take(int order, uint32_t limit, uint32_t& block);
+	void grow();
+	void reallocate(size_t blocks);
+	void insert_free(uint32_t block, int order);
+
+	GLuint _vao;
+	GLuint _vbo[3];
+	GLuint _origins;
+	GLuint _origin_texture;
+	GLint _attributes[3];
+	GLuint _unit;
+
+	// The arena spans block_size << _order vertices
+	int _order;
+	std::vector<std::set<uint32_t>> _free;
+	std::vector<int8_t> _allocated; // order of the allocation starting at each block, or -1
+	size_t _used;
+};
+
+
+#endif // mesh_arena_h
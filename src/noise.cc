@@ -0,0 +1,206 @@
+#include "noise.h"
+
+
+/*
+ * Compile time tables
+ */
+
+template<unsigned... I>
+struct index_list {
+};
+
+template<unsigned N, unsigned... I>
+struct make_index_list : make_index_list<N - 1, N - 1, I...> {
+};
+
+template<unsigned... I>
+struct make_index_list<0, I...> {
+	typedef index_list<I...> type;
+};
+
+// A bijection on [0, 255], since multiplying by an odd number, adding,
+// xor-shifting and xor-ing are all invertible modulo 256.
+static constexpr uint8_t base_permutation(unsigned i) {
+	return uint8_t((uint8_t(i * 167u + 71u) ^ (uint8_t(i * 167u + 71u) >> 3)) ^ 0x5au);
+}
+
+template<typename T>
+struct permutation_table;
+
+template<unsigned... I>
+struct permutation_table<index_list<I...>> {
+	static constexpr uint8_t values[sizeof...(I)] = { base_permutation(I)... };
+};
+
+template<unsigned... I>
+constexpr uint8_t permutation_table<index_list<I...>>::values[sizeof...(I)];
+
+typedef permutation_table<make_index_list<256>::type> base_table;
+
+static_assert(sizeof(base_table::values) == 256, "the permutation table must cover a byte");
+
+static constexpr int8_t grad2[8][2] = {
+	{ 1,  1 }, { -1,  1 }, { 1, -1 }, { -1, -1 },
+	{ 1,  0 }, { -1,  0 }, { 0,  1 }, {  0, -1 },
+};
+
+static constexpr int8_t grad3[12][3] = {
+	{ 1,  1,  0 }, { -1,  1,  0 }, { 1, -1,  0 }, { -1, -1,  0 },
+	{ 1,  0,  1 }, { -1,  0,  1 }, { 1,  0, -1 }, { -1,  0, -1 },
+	{ 0,  1,  1 }, {  0, -1,  1 }, { 0,  1, -1 }, {  0, -1, -1 },
+};
+
+// Skewing and unskewing factors: (sqrt(n + 1) - 1) / n and (1 - 1 / sqrt(n + 1)) / n
+static constexpr float F2 = 0.366025403784f;
+static constexpr float G2 = 0.211324865405f;
+static constexpr float F3 = 1.0f / 3.0f;
+static constexpr float G3 = 1.0f / 6.0f;
+
+
+static inline int fast_floor(float value) {
+	const int i = int(value);
+	return value < float(i) ? i - 1 : i;
+}
+
+// The sum of the corner contributions can slightly exceed [-1, 1] after scaling
+static inline float clamp_unit(float value) {
+	return value > 1.0f ? 1.0f : (value < -1.0f ? -1.0f : value);
+}
+
+static inline float corner2(int gi, float x, float y) {
+	float t = 0.5f - x * x - y * y;
+
+	if (t < 0.0f) {
+		return 0.0f;
+	}
+
+	t *= t;
+	return t * t * (grad2[gi][0] * x + grad2[gi][1] * y);
+}
+
+static inline float corner3(int gi, float x, float y, float z) {
+	float t = 0.6f - x * x - y * y - z * z;
+
+	if (t < 0.0f) {
+		return 0.0f;
+	}
+
+	t *= t;
+	return t * t * (grad3[gi][0] * x + grad3[gi][1] * y + grad3[gi][2] * z);
+}
+
+
+simplex_noise::simplex_noise(unsigned int seed) {
+	for (int i = 0; i < 256; i++) {
+		this->_perm[i] = base_table::values[i];
+	}
+
+	// Fisher-Yates shuffle driven by xorshift32 (which gets stuck on 0)
+	uint32_t state = seed * 0x9e3779b1u + 0x7f4a7c15u;
+	state = state ? state : 1;
+
+	for (int i = 255; i > 0; i--) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+
+		const int j = int(state % uint32_t(i + 1));
+		const uint8_t tmp = this->_perm[i];
+		this->_perm[i] = this->_perm[j];
+		this->_perm[j] = tmp;
+	}
+
+	// Duplicated to avoid wrapping the index when hashing neighbouring corners
+	for (int i = 0; i < 256; i++) {
+		this->_perm[256 + i] = this->_perm[i];
+	}
+}
+
+float simplex_noise::noise2(float x, float y) const {
+	// Find the simplex cell
+	const float s = (x + y) * F2;
+	const int i = fast_floor(x + s);
+	const int j = fast_floor(y + s);
+	const float t = float(i + j) * G2;
+
+	// Distances from the cell origin
+	const float x0 = x - (float(i) - t);
+	const float y0 = y - (float(j) - t);
+
+	// Which of the 2 triangles are we in?
+	const int i1 = x0 > y0 ? 1 : 0;
+	const int j1 = 1 - i1;
+
+	const float x1 = x0 - float(i1) + G2;
+	const float y1 = y0 - float(j1) + G2;
+	const float x2 = x0 - 1.0f + 2.0f * G2;
+	const float y2 = y0 - 1.0f + 2.0f * G2;
+
+	const int ii = i & 255;
+	const int jj = j & 255;
+	const uint8_t* perm = this->_perm;
+
+	const float n = corner2(perm[ii + perm[jj]] & 7, x0, y0)
+	              + corner2(perm[ii + i1 + perm[jj + j1]] & 7, x1, y1)
+	              + corner2(perm[ii + 1 + perm[jj + 1]] & 7, x2, y2);
+
+	return clamp_unit(70.0f * n);
+}
+
+float simplex_noise::noise3(float x, float y, float z) const {
+	// Find the simplex cell
+	const float s = (x + y + z) * F3;
+	const int i = fast_floor(x + s);
+	const int j = fast_floor(y + s);
+	const int k = fast_floor(z + s);
+	const float t = float(i + j + k) * G3;
+
+	// Distances from the cell origin
+	const float x0 = x - (float(i) - t);
+	const float y0 = y - (float(j) - t);
+	const float z0 = z - (float(k) - t);
+
+	// Which of the 6 tetrahedrons are we in?
+	int i1, j1, k1;
+	int i2, j2, k2;
+
+	if (x0 >= y0) {
+		if (y0 >= z0) {
+			i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 1; k2 = 0;
+		} else if (x0 >= z0) {
+			i1 = 1; j1 = 0; k1 = 0; i2 = 1; j2 = 0; k2 = 1;
+		} else {
+			i1 = 0; j1 = 0; k1 = 1; i2 = 1; j2 = 0; k2 = 1;
+		}
+	} else {
+		if (y0 < z0) {
+			i1 = 0; j1 = 0; k1 = 1; i2 = 0; j2 = 1; k2 = 1;
+		} else if (x0 < z0) {
+			i1 = 0; j1 = 1; k1 = 0; i2 = 0; j2 = 1; k2 = 1;
+		} else {
+			i1 = 0; j1 = 1; k1 = 0; i2 = 1; j2 = 1; k2 = 0;
+		}
+	}
+
+	const float x1 = x0 - float(i1) + G3;
+	const float y1 = y0 - float(j1) + G3;
+	const float z1 = z0 - float(k1) + G3;
+	const float x2 = x0 - float(i2) + 2.0f * G3;
+	const float y2 = y0 - float(j2) + 2.0f * G3;
+	const float z2 = z0 - float(k2) + 2.0f * G3;
+	const float x3 = x0 - 1.0f + 3.0f * G3;
+	const float y3 = y0 - 1.0f + 3.0f * G3;
+	const float z3 = z0 - 1.0f + 3.0f * G3;
+
+	const int ii = i & 255;
+	const int jj = j & 255;
+	const int kk = k & 255;
+	const uint8_t* perm = this->_perm;
+
+	const float n = corner3(perm[ii + perm[jj + perm[kk]]] % 12, x0, y0, z0)
+	              + corner3(perm[ii + i1 + perm[jj + j1 + perm[kk + k1]]] % 12, x1, y1, z1)
+	              + corner3(perm[ii + i2 + perm[jj + j2 + perm[kk + k2]]] % 12, x2, y2, z2)
+	              + corner3(perm[ii + 1 + perm[jj + 1 + perm[kk + 1]]] % 12, x3, y3, z3);
+
+	return clamp_unit(32.0f * n);
+}
@@ -0,0 +1,26 @@
+#ifndef noise_h
+#define noise_h
+
+#include <cstdint>
+
+
+/*
+ * Seedable 2D and 3D simplex noise in the range [-1, 1].
+ *
+ * The gradients and the base permutation are constexpr tables. Each instance
+ * shuffles the permutation with its seed using integer arithmetic only, so that
+ * the same seed results in the same world with every compiler and platform.
+ */
+class simplex_noise {
+public:
+	explicit simplex_noise(unsigned int seed);
+
+	float noise2(float x, float y) const;
+	float noise3(float x, float y, float z) const;
+
+private:
+	uint8_t _perm[512];
+};
+
+
+#endif // noise_h
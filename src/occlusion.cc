@@ -0,0 +1,223 @@
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+# define OCCLUSION_USE_SSE 1
+# include <xmmintrin.h>
+#endif
+
+
+// Corners are indexed by their bits: 1 = max.x, 2 = max.y, 4 = max.z.
+// Each face is counter-clockwise when looking at it from the outside.
+static const int box_faces[6][4] = {
+	{ 0, 4, 6, 2 }, // -x
+	{ 1, 3, 7, 5 }, // +x
+	{ 0, 1, 5, 4 }, // -y
+	{ 2, 6, 7, 3 }, // +y
+	{ 0, 2, 3, 1 }, // -z
+	{ 4, 5, 7, 6 }, // +z
+};
+
+static glm::vec4 box_corner(const glm::mat4& pv, const glm::vec3& min, const glm::vec3& max, int i) {
+	return pv * glm::vec4((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z, 1.0f);
+}
+
+
+occlusion_buffer::occlusion_buffer() : _depth(width * height, 1.0f), _pv(1.0f) {
+}
+
+void occlusion_buffer::clear(const glm::mat4& pv) {
+	this->_pv = pv;
+	std::fill(this->_depth.begin(), this->_depth.end(), 1.0f);
+}
+
+void occlusion_buffer::add_occluder(const glm::vec3& min, const glm::vec3& max) {
+	glm::vec4 corners[8];
+
+	for (int i = 0; i < 8; i++) {
+		corners[i] = box_corner(this->_pv, min, max, i);
+	}
+
+	for (int f = 0; f < 6; f++) {
+		// Clip the face against the near plane (z + w >= 0), which turns the quad into up to a pentagon
+		glm::vec4 poly[5];
+		int n = 0;
+
+		for (int i = 0; i < 4; i++) {
+			const glm::vec4& a = corners[box_faces[f][i]];
+			const glm::vec4& b = corners[box_faces[f][(i + 1) & 3]];
+			const float da = a.z + a.w;
+			const float db = b.z + b.w;
+
+			if (da >= 0.0f) {
+				poly[n++] = a;
+			}
+
+			if ((da >= 0.0f) != (db >= 0.0f)) {
+				const float t = da / (da - db);
+				poly[n++] = a + (b - a) * t;
+			}
+		}
+
+		if (n < 3) {
+			continue;
+		}
+
+		glm::vec3 screen[5];
+
+		for (int i = 0; i < n; i++) {
+			screen[i] = this->to_screen(poly[i]);
+		}
+
+		for (int i = 1; i + 1 < n; i++) {
+			this->rasterize(screen[0], screen[i], screen[i + 1]);
+		}
+	}
+}
+
+bool occlusion_buffer::occluded(const glm::vec3& min, const glm::vec3& max) const {
+	float sx0 = std::numeric_limits<float>::max();
+	float sy0 = std::numeric_limits<float>::max();
+	float sx1 = -std::numeric_limits<float>::max();
+	float sy1 = -std::numeric_limits<float>::max();
+	float zmin = std::numeric_limits<float>::max();
+
+	for (int i = 0; i < 8; i++) {
+		const glm::vec4 clip = box_corner(this->_pv, min, max, i);
+
+		// Boxes crossing the near plane are always visible
+		if (clip.z + clip.w < 0.0f || clip.w <= 0.0f) {
+			return false;
+		}
+
+		const glm::vec3 screen = this->to_screen(clip);
+		sx0 = std::min(sx0, screen.x);
+		sy0 = std::min(sy0, screen.y);
+		sx1 = std::max(sx1, screen.x);
+		sy1 = std::max(sy1, screen.y);
+		zmin = std::min(zmin, screen.z);
+	}
+
+	const int x0 = std::max(int(std::floor(sx0)), 0);
+	const int y0 = std::max(int(std::floor(sy0)), 0);
+	const int x1 = std::min(int(std::ceil(sx1)), int(width) - 1);
+	const int y1 = std::min(int(std::ceil(sy1)), int(height) - 1);
+
+	if (x0 > x1 || y0 > y1) {
+		return false;
+	}
+
+	for (int y = y0; y <= y1; y++) {
+		const float* row = this->_depth.data() + y * width;
+		int x = x0;
+
+#ifdef OCCLUSION_USE_SSE
+		const __m128 z = _mm_set1_ps(zmin);
+
+		for (; x + 3 <= x1; x += 4) {
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), z))) {
+				return false;
+			}
+		}
+#endif
+
+		for (; x <= x1; x++) {
+			if (row[x] >= zmin) {
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+glm::vec3 occlusion_buffer::to_screen(const glm::vec4& clip) const {
+	return glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * width, (clip.y / clip.w * 0.5f + 0.5f) * height, clip.z / clip.w);
+}
+
+void occlusion_buffer::rasterize(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+	const float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+
+	// Back facing or degenerate
+	if (!(area > 0.0f)) {
+		return;
+	}
+
+	const int x1 = std::min(int(std::ceil(std::max(a.x, std::max(b.x, c.x)))), int(width) - 1);
+	const int y0 = std::max(int(std::floor(std::min(a.y, std::min(b.y, c.y)))), 0);
+	const int y1 = std::min(int(std::ceil(std::max(a.y, std::max(b.y, c.y)))), int(height) - 1);
+
+	// Start at a multiple of 4, so that a group of 4 pixels never crosses the end of a row
+	const int x0 = std::max(int(std::floor(std::min(a.x, std::min(b.x, c.x)))), 0) & ~3;
+
+	if (x0 > x1 || y0 > y1) {
+		return;
+	}
+
+	// Edge functions e(x, y) = A * x + B * y + C, which are positive inside the triangle
+	const glm::vec3* v[3] = { &a, &b, &c };
+	float ea[3];
+	float eb[3];
+	float ec[3];
+
+	for (int i = 0; i < 3; i++) {
+		const glm::vec3& p = *v[i];
+		const glm::vec3& q = *v[(i + 1) % 3];
+		ea[i] = p.y - q.y;
+		eb[i] = q.x - p.x;
+		ec[i] = -(ea[i] * p.x + eb[i] * p.y);
+	}
+
+	// Depth as a plane over the screen, using the barycentric weights e(x, y) / area.
+	// The edge opposite to a vertex is the one starting at the next vertex.
+	const float za = (ea[1] * a.z + ea[2] * b.z + ea[0] * c.z) / area;
+	const float zb = (eb[1] * a.z + eb[2] * b.z + eb[0] * c.z) / area;
+	const float zc = (ec[1] * a.z + ec[2] * b.z + ec[0] * c.z) / area;
+
+	for (int y = y0; y <= y1; y++) {
+		const float py = float(y) + 0.5f;
+		float* row = this->_depth.data() + y * width;
+
+#ifdef OCCLUSION_USE_SSE
+		const __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		const __m128 zero = _mm_setzero_ps();
+		__m128 e[3];
+		__m128 step[3];
+
+		for (int i = 0; i < 3; i++) {
+			const __m128 px = _mm_add_ps(_mm_set1_ps(float(x0)), offsets);
+			e[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ea[i]), px), _mm_set1_ps(eb[i] * py + ec[i]));
+			step[i] = _mm_set1_ps(ea[i] * 4.0f);
+		}
+
+		__m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(za), _mm_add_ps(_mm_set1_ps(float(x0)), offsets)), _mm_set1_ps(zb * py + zc));
+		const __m128 zstep = _mm_set1_ps(za * 4.0f);
+
+		for (int x = x0; x <= x1; x += 4) {
+			const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(e[0], zero), _mm_cmpge_ps(e[1], zero)), _mm_cmpge_ps(e[2], zero));
+
+			if (_mm_movemask_ps(inside)) {
+				const __m128 depth = _mm_loadu_ps(row + x);
+				const __m128 nearest = _mm_min_ps(depth, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, depth)));
+			}
+
+			e[0] = _mm_add_ps(e[0], step[0]);
+			e[1] = _mm_add_ps(e[1], step[1]);
+			e[2] = _mm_add_ps(e[2], step[2]);
+			z = _mm_add_ps(z, zstep);
+		}
+#else
+		for (int x = x0; x <= x1; x++) {
+			const float px = float(x) + 0.5f;
+
+			if (ea[0] * px + eb[0] * py + ec[0] >= 0.0f && ea[1] * px + eb[1] * py + ec[1] >= 0.0f && ea[2] * px + eb[2] * py + ec[2] >= 0.0f) {
+				row[x] = std::min(row[x], za * px + zb * py + zc);
+			}
+		}
+#endif
+	}
+}
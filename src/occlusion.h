@@ -0,0 +1,40 @@
+#ifndef occlusion_h
+#define occlusion_h
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+
+/*
+ * A small software depth buffer for occlusion culling on the CPU.
+ *
+ * Boxes known to be solid are rasterized as occluders, 4 pixels at a time using SSE
+ * where available. Afterwards bounding boxes can be tested against the buffer:
+ * A box is occluded if its nearest depth is behind the occluders on every pixel it covers.
+ */
+class occlusion_buffer {
+public:
+	enum {
+		width = 256,
+		height = 128,
+	};
+
+	occlusion_buffer();
+
+	// Resets the buffer for a new frame with the given projection * view matrix
+	void clear(const glm::mat4& pv);
+
+	void add_occluder(const glm::vec3& min, const glm::vec3& max);
+	bool occluded(const glm::vec3& min, const glm::vec3& max) const;
+
+private:
+	glm::vec3 to_screen(const glm::vec4& clip) const;
+	void rasterize(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+	std::vector<float> _depth;
+	glm::mat4 _pv;
+};
+
+
+#endif // occlusion_h
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "region.h"
+#include "world.h"
+#include "worldgen.h"
+
+
+/*
+ * Headless world pre-generation.
+ *
+ * Generates a region of the world without a GL context and writes it to disk,
+ * where glcraft can pick it up at startup (pass the file as its first argument).
+ */
+
+static void usage() {
+	std::cerr << "usage: glcraft_pregen <output> [-seed N] [-x AX] [-z AZ] [-width W] [-depth D] [-threads N]" << std::endl;
+	std::cerr << "  AX, AZ, W and D are in chunks and default to the area glcraft keeps in memory." << std::endl;
+}
+
+static bool parse_int(const char* str, long& value) {
+	char* end;
+	value = std::strtol(str, &end, 10);
+	return *str && !*end;
+}
+
+// Calls fn(gen, ax, az) for every column (x, z) of the region with x % step == px and z % step == pz.
+// A column is always handled by the same generator, so its heightmap is cached across multiple passes.
+template<typename F>
+static void parallel_columns(std::vector<worldgen>& gens, const region& r, int step, int px, int pz, F fn) {
+	std::vector<std::thread> threads;
+
+	for (size_t t = 0; t < gens.size(); t++) {
+		threads.emplace_back([&gens, &r, &fn, step, px, pz, t]() {
+			for (int x = px; x < r.width(); x += step) {
+				for (int z = pz; z < r.depth(); z += step) {
+					if (size_t(x * r.depth() + z) % gens.size() == t) {
+						fn(gens[t], r.ax() + x, r.az() + z);
+					}
+				}
+			}
+		});
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+int main(int argc, char* argv[]) {
+	if (argc < 2 || argv[1][0] == '-') {
+		usage();
+		return 1;
+	}
+
+	const std::string path = argv[1];
+	long seed = long(time(nullptr));
+	long ax = -SCX / 2;
+	long az = -SCZ / 2;
+	long width = SCX;
+	long depth = SCZ;
+	long threads = long(std::thread::hardware_concurrency());
+
+	for (int i = 2; i < argc; i += 2) {
+		long* value = nullptr;
+
+		if (!strcmp(argv[i], "-seed")) {
+			value = &seed;
+		} else if (!strcmp(argv[i], "-x")) {
+			value = &ax;
+		} else if (!strcmp(argv[i], "-z")) {
+			value = &az;
+		} else if (!strcmp(argv[i], "-width")) {
+			value = &width;
+		} else if (!strcmp(argv[i], "-depth")) {
+			value = &depth;
+		} else if (!strcmp(argv[i], "-threads")) {
+			value = &threads;
+		}
+
+		if (!value || i + 1 >= argc || !parse_int(argv[i + 1], *value)) {
+			usage();
+			return 1;
+		}
+	}
+
+	if (width <= 0 || depth <= 0) {
+		usage();
+		return 1;
+	}
+
+	// More threads than a few per core only add overhead, and far more couldn't even be created
+	const long cores = std::max(long(std::thread::hardware_concurrency()), 1L);
+	threads = std::min(std::max(threads, 1L), cores * 4);
+
+	try {
+		region r((unsigned int)seed, int(ax), int(az), int(width), int(depth));
+		// Every generator keeps the heightmaps of all its columns for pass 2, they are freed together with the generators
+		const size_t columns = size_t((width * depth + threads - 1) / threads);
+		std::vector<worldgen> gens(size_t(threads), worldgen((unsigned int)seed, columns));
+
+		const auto start = std::chrono::steady_clock::now();
+
+		// Pass 1: terrain. Columns are independent of each other.
+		parallel_columns(gens, r, 1, 0, 0, [&r](worldgen& gen, int cx, int cz) {
+			const worldgen::column& col = gen.heightmap(cx, cz);
+
+			for (int cy = -SCY / 2; cy < SCY - SCY / 2; cy++) {
+				region::blocks_t& blk = r.blocks(cx, cy, cz);
+				gen.strata(blk, col, cx, cy, cz);
+				gen.fluids(blk, col, cy);
+			}
+		});
+
+		// Pass 2: trees, which reach at most 1 column into each direction.
+		// Columns processed concurrently are 3 apart, so they never touch the same blocks.
+		for (int phase = 0; phase < 9; phase++) {
+			parallel_columns(gens, r, 3, phase % 3, phase / 3, [&r](worldgen& gen, int cx, int cz) {
+				const worldgen::column& col = gen.heightmap(cx, cz);
+
+				for (int cy = -SCY / 2; cy < SCY - SCY / 2; cy++) {
+					region::volume v(r, cx, cy, cz);
+					gen.decoration(v, col, cx, cy, cz);
+				}
+			});
+		}
+
+		const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const long chunks = width * depth * SCY;
+
+		worldgen::stats stats = {};
+
+		for (const auto& gen : gens) {
+			stats.heightmap += gen.timings().heightmap;
+			stats.strata += gen.timings().strata;
+			stats.fluids += gen.timings().fluids;
+			stats.decoration += gen.timings().decoration;
+			stats.columns += gen.timings().columns;
+			stats.chunks += gen.timings().chunks;
+		}
+
+		std::cout << "generated " << chunks << " chunks with seed " << (unsigned int)seed << " on " << threads << " threads" << std::endl;
+		std::cout << "  " << elapsed * 1000.0 << " ms, " << chunks / elapsed << " chunks/s" << std::endl;
+		std::cout << "  heightmap:  " << stats.heightmap * 1000.0 << " ms (CPU), " << stats.columns << " columns" << std::endl;
+		std::cout << "  strata:     " << stats.strata * 1000.0 << " ms (CPU), " << stats.chunks << " chunks" << std::endl;
+		std::cout << "  fluids:     " << stats.fluids * 1000.0 << " ms (CPU)" << std::endl;
+		std::cout << "  decoration: " << stats.decoration * 1000.0 << " ms (CPU)" << std::endl;
+
+		r.save(path);
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 127;
+	}
+
+	return 0;
+}
@@ -0,0 +1,100 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+
+profiler::profiler() : _current(), _samples(size_t(history) * slot_count, 0.0), _next(0), _frames(0) {
+}
+
+profiler& profiler::instance() {
+	static profiler p;
+	return p;
+}
+
+const char* profiler::name(phase p) {
+	static const char* const names[phase_count] = { "input", "culling", "generate", "mesh", "upload", "draw", "picking", "swap", "gpu_chunks", "gpu_overlay" };
+	return names[p];
+}
+
+const char* profiler::name(counter c) {
+	static const char* const names[counter_count] = { "draw_calls", "triangles", "upload_bytes", "program_binds", "vertex_array_binds" };
+	return names[c];
+}
+
+void profiler::add(phase p, double seconds) {
+	this->_current[p] += seconds;
+}
+
+void profiler::set(counter c, double value) {
+	this->_current[phase_count + c] = value;
+}
+
+void profiler::end_frame() {
+	std::copy(this->_current, this->_current + slot_count, this->_samples.begin() + this->_next * slot_count);
+	std::fill(this->_current, this->_current + slot_count, 0.0);
+
+	this->_next = (this->_next + 1) % history;
+	this->_frames = std::min<size_t>(this->_frames + 1, history);
+}
+
+size_t profiler::frames() const {
+	return this->_frames;
+}
+
+profiler::summary profiler::report(phase p) const {
+	return this->report_slot(p);
+}
+
+profiler::summary profiler::report(counter c) const {
+	return this->report_slot(phase_count + c);
+}
+
+profiler::summary profiler::report_slot(int slot) const {
+	summary s = {};
+
+	if (!this->_frames) {
+		return s;
+	}
+
+	std::vector<double> values(this->_frames);
+
+	for (size_t i = 0; i < this->_frames; i++) {
+		values[i] = this->_samples[i * slot_count + slot];
+	}
+
+	std::sort(values.begin(), values.end());
+
+	// Nearest rank
+	const auto percentile = [&values](double q) {
+		return values[std::min(size_t(q * values.size()), values.size() - 1)];
+	};
+
+	s.p50 = percentile(0.50);
+	s.p95 = percentile(0.95);
+	s.p99 = percentile(0.99);
+	s.max = values.back();
+
+	return s;
+}
+
+void profiler::write_csv(const std::string& path) const {
+	std::ofstream fd(path, std::ios::trunc);
+
+	if (!fd) {
+		throw std::runtime_error("Failed to open file!");
+	}
+
+	fd << "name,unit,frames,p50,p95,p99,max" << std::endl;
+
+	for (int p = 0; p < phase_count; p++) {
+		const summary s = this->report(phase(p));
+		fd << name(phase(p)) << ",ms," << this->_frames << ',' << s.p50 * 1000.0 << ',' << s.p95 * 1000.0 << ',' << s.p99 * 1000.0 << ',' << s.max * 1000.0 << std::endl;
+	}
+
+	for (int c = 0; c < counter_count; c++) {
+		const summary s = this->report(counter(c));
+		fd << name(counter(c)) << (c == counter_upload_bytes ? ",bytes," : ",count,") << this->_frames << ',' << s.p50 << ',' << s.p95 << ',' << s.p99 << ',' << s.max << std::endl;
+	}
+}
@@ -0,0 +1,114 @@
+#ifndef profiler_h
+#define profiler_h
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+/*
+ * CPU time spent in each phase of a frame, kept for the last history frames.
+ *
+ * PROFILE_SCOPE() adds the time until the end of the enclosing scope to a phase of the
+ * current frame and PROFILE_FRAME() moves the frame into the ring buffer. Both compile
+ * to nothing unless GLCRAFT_PROFILE is defined, which only Debug builds do.
+ * Counters are per frame values like the number of draw calls, reported the same way.
+ */
+class profiler {
+public:
+	enum phase {
+		phase_input,
+		phase_culling,
+		phase_generate,
+		phase_mesh,
+		phase_upload,
+		phase_draw,
+		phase_picking,
+		phase_swap,
+
+		// GPU time of the render passes, measured by gpu_timer
+		phase_gpu_chunks,
+		phase_gpu_overlay,
+
+		phase_count,
+	};
+
+	enum counter {
+		counter_draw_calls,
+		counter_triangles,
+		counter_upload_bytes,
+		counter_program_binds,
+		counter_vertex_array_binds,
+		counter_count,
+	};
+
+	enum {
+		history = 1024,
+	};
+
+	// Over all frames in the history, in seconds for phases
+	struct summary {
+		double p50;
+		double p95;
+		double p99;
+		double max;
+	};
+
+	class scope {
+	public:
+		explicit scope(phase p) : _phase(p), _start(std::chrono::steady_clock::now()) {
+		}
+
+		~scope() {
+			profiler::instance().add(this->_phase, std::chrono::duration<double>(std::chrono::steady_clock::now() - this->_start).count());
+		}
+
+	private:
+		phase _phase;
+		std::chrono::steady_clock::time_point _start;
+	};
+
+	static profiler& instance();
+	static const char* name(phase p);
+	static const char* name(counter c);
+
+	void add(phase p, double seconds);
+	void set(counter c, double value);
+	void end_frame();
+
+	size_t frames() const;
+	summary report(phase p) const;
+	summary report(counter c) const;
+
+	// One line per phase with its percentiles in milliseconds, followed by one per counter
+	void write_csv(const std::string& path) const;
+
+private:
+	enum {
+		slot_count = phase_count + counter_count, // phases first, then counters
+	};
+
+	profiler();
+
+	summary report_slot(int slot) const;
+
+	double _current[slot_count];
+	std::vector<double> _samples; // slot_count per frame
+	size_t _next;
+	size_t _frames;
+};
+
+
+#ifdef GLCRAFT_PROFILE
+# define PROFILE_CONCAT_(a, b) a##b
+# define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+# define PROFILE_SCOPE(p) profiler::scope PROFILE_CONCAT(profile_scope_, __LINE__)(profiler::p)
+# define PROFILE_FRAME() profiler::instance().end_frame()
+#else
+# define PROFILE_SCOPE(p)
+# define PROFILE_FRAME()
+#endif
+
+
+#endif // profiler_h
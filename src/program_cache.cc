@@ -0,0 +1,230 @@
+#include "program_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#include "gl_service.h"
+
+
+static const char cache_magic[4] = { 'G', 'L', 'C', 'P' };
+static const uint32_t cache_version = 1;
+
+// Larger sizes can only come from a damaged file
+static const uint32_t max_driver_size = 4096;
+static const uint32_t max_binary_size = 64 << 20;
+
+
+// FNV-1a, continuing from a previous hash
+static uint64_t hash(uint64_t h, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*)data;
+
+	for (size_t i = 0; i < size; i++) {
+		h = (h ^ bytes[i]) * 1099511628211ull;
+	}
+
+	return h;
+}
+
+static std::string gl_string(GLenum name) {
+	const GLubyte* s = glGetString(name);
+	return s ? std::string((const char*)s) : std::string();
+}
+
+static void write_u32(std::ofstream& fd, uint32_t value) {
+	const uint8_t data[4] = { uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24) };
+	fd.write((const char*)data, sizeof(data));
+}
+
+static bool read_u32(std::ifstream& fd, uint32_t& value) {
+	uint8_t data[4];
+
+	if (!fd.read((char*)data, sizeof(data))) {
+		return false;
+	}
+
+	value = uint32_t(data[0]) | (uint32_t(data[1]) << 8) | (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24);
+	return true;
+}
+
+
+program_cache::program_cache(const std::string& path) : _path(path), _supported(false), _changed(false), _stats() {
+	GLint formats = 0;
+
+	if (glProgramBinary && glGetProgramBinary) {
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	}
+
+	this->_supported = formats > 0;
+	this->_driver = gl_string(GL_VENDOR) + '\n' + gl_string(GL_RENDERER) + '\n' + gl_string(GL_VERSION);
+
+	if (this->_supported) {
+		this->load();
+	}
+}
+
+GLuint program_cache::program_from_file(const std::string& vsPath, const std::string& fsPath) {
+	const auto vs = gl_service::load_file(vsPath);
+	const auto fs = gl_service::load_file(fsPath);
+	return this->program_from_source(std::string(vs.begin(), vs.end()), std::string(fs.begin(), fs.end()));
+}
+
+GLuint program_cache::program_from_source(const std::string& vs, const std::string& fs) {
+	const auto start = std::chrono::steady_clock::now();
+
+	// The sizes keep "ab" + "c" apart from "a" + "bc"
+	const uint64_t vsSize = vs.size();
+	const uint64_t fsSize = fs.size();
+
+	uint64_t key = 14695981039346656037ull;
+	key = hash(key, &vsSize, sizeof(vsSize));
+	key = hash(key, vs.data(), vs.size());
+	key = hash(key, &fsSize, sizeof(fsSize));
+	key = hash(key, fs.data(), fs.size());
+	key = hash(key, this->_driver.data(), this->_driver.size());
+
+	GLuint program = 0;
+
+	if (this->_supported) {
+		const auto it = this->_entries.find(key);
+
+		if (it != this->_entries.end()) {
+			program = this->program_from_binary(it->second);
+
+			if (!program) {
+				this->_entries.erase(it);
+				this->_changed = true;
+			}
+		}
+	}
+
+	if (program) {
+		this->_stats.hits++;
+	} else {
+		program = gl_service::program_from_source((const uint8_t*)vs.data(), vs.size(), (const uint8_t*)fs.data(), fs.size());
+		this->_stats.misses++;
+
+		GLint length = 0;
+
+		if (this->_supported) {
+			glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		}
+
+		if (length > 0) {
+			entry e;
+			e.binary.resize(size_t(length));
+			glGetProgramBinary(program, length, &length, &e.format, e.binary.data());
+			e.binary.resize(size_t(length));
+
+			this->_entries[key] = std::move(e);
+			this->_changed = true;
+		}
+	}
+
+	this->_stats.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return program;
+}
+
+void program_cache::save() {
+	if (!this->_changed) {
+		return;
+	}
+
+	std::ofstream fd(this->_path, std::ios::binary | std::ios::trunc);
+
+	if (!fd) {
+		throw std::runtime_error("Failed to open file!");
+	}
+
+	fd.write(cache_magic, sizeof(cache_magic));
+	write_u32(fd, cache_version);
+	write_u32(fd, uint32_t(this->_driver.size()));
+	fd.write(this->_driver.data(), this->_driver.size());
+	write_u32(fd, uint32_t(this->_entries.size()));
+
+	for (const auto& it : this->_entries) {
+		write_u32(fd, uint32_t(it.first));
+		write_u32(fd, uint32_t(it.first >> 32));
+		write_u32(fd, it.second.format);
+		write_u32(fd, uint32_t(it.second.binary.size()));
+		fd.write((const char*)it.second.binary.data(), it.second.binary.size());
+	}
+
+	if (!fd) {
+		throw std::runtime_error("Failed to write program cache!");
+	}
+
+	this->_changed = false;
+}
+
+bool program_cache::supported() const {
+	return this->_supported;
+}
+
+const program_cache::stats& program_cache::statistics() const {
+	return this->_stats;
+}
+
+void program_cache::load() {
+	std::ifstream fd(this->_path, std::ios::binary);
+
+	if (!fd) {
+		return;
+	}
+
+	char magic[4];
+	uint32_t version = 0;
+	uint32_t driver_size = 0;
+
+	if (!fd.read(magic, sizeof(magic)) || !std::equal(magic, magic + 4, cache_magic) || !read_u32(fd, version) || version != cache_version || !read_u32(fd, driver_size) || driver_size > max_driver_size) {
+		return;
+	}
+
+	// Binaries of another driver would be rejected one by one anyway
+	std::string driver(driver_size, '\0');
+
+	if (!fd.read(&driver[0], driver_size) || driver != this->_driver) {
+		return;
+	}
+
+	uint32_t count = 0;
+
+	if (!read_u32(fd, count)) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t lo, hi, format, size;
+
+		if (!read_u32(fd, lo) || !read_u32(fd, hi) || !read_u32(fd, format) || !read_u32(fd, size) || size > max_binary_size) {
+			break;
+		}
+
+		entry e;
+		e.format = format;
+		e.binary.resize(size);
+
+		if (!fd.read((char*)e.binary.data(), size)) {
+			break;
+		}
+
+		this->_entries[uint64_t(lo) | (uint64_t(hi) << 32)] = std::move(e);
+	}
+}
+
+GLuint program_cache::program_from_binary(const entry& e) const {
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, e.format, e.binary.data(), GLsizei(e.binary.size()));
+
+	GLint result = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &result);
+
+	if (result == GL_FALSE) {
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return program;
+}
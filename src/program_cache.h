@@ -0,0 +1,59 @@
+#ifndef program_cache_h
+#define program_cache_h
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <GL/glew.h>
+
+
+/*
+ * Keeps the binaries of linked programs on disk, so that later runs don't have to compile their shaders again.
+ *
+ * Programs are keyed by a hash of their sources and of the GL vendor, renderer and version strings.
+ * Binaries the driver refuses anyway, e.g. after an update which didn't change the version string,
+ * are compiled from source again and replaced. Without support for program binaries it does nothing.
+ */
+class program_cache {
+public:
+	struct stats {
+		size_t hits;
+		size_t misses;
+		double seconds; // spent creating programs, cached or not
+	};
+
+	// Reads the cache file if it exists, a missing or unreadable one is the same as an empty one
+	explicit program_cache(const std::string& path);
+
+	// Same as gl_service::program_from_file() and program_from_source()
+	GLuint program_from_file(const std::string& vsPath, const std::string& fsPath);
+	GLuint program_from_source(const std::string& vs, const std::string& fs);
+
+	// Writes the cache file, unless nothing was added to it
+	void save();
+
+	bool supported() const;
+	const stats& statistics() const;
+
+private:
+	struct entry {
+		GLenum format;
+		std::vector<uint8_t> binary;
+	};
+
+	void load();
+	GLuint program_from_binary(const entry& e) const;
+
+	std::string _path;
+	std::string _driver;
+	std::unordered_map<uint64_t, entry> _entries;
+	bool _supported;
+	bool _changed;
+	stats _stats;
+};
+
+
+#endif // program_cache_h
@@ -0,0 +1,33 @@
+#include "radix_sort.h"
+
+
+void radix_sort(std::vector<uint32_t>& values, std::vector<uint32_t>& scratch) {
+	scratch.resize(values.size());
+
+	for (int shift = 16; shift < 32; shift += 8) {
+		size_t offsets[256] = {};
+
+		for (uint32_t value : values) {
+			offsets[(value >> shift) & 0xff]++;
+		}
+
+		// Nothing to do if all values share this byte
+		if (offsets[(values.empty() ? 0 : values[0] >> shift) & 0xff] == values.size()) {
+			continue;
+		}
+
+		size_t sum = 0;
+
+		for (size_t& offset : offsets) {
+			const size_t count = offset;
+			offset = sum;
+			sum += count;
+		}
+
+		for (uint32_t value : values) {
+			scratch[offsets[(value >> shift) & 0xff]++] = value;
+		}
+
+		values.swap(scratch);
+	}
+}
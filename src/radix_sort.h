@@ -0,0 +1,17 @@
+#ifndef radix_sort_h
+#define radix_sort_h
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+/*
+ * Stable LSD radix sort of the values by their upper 16 bits, one byte per pass.
+ * The lower 16 bits are left for a payload, like an index into another array.
+ * scratch is resized as needed, so it can be reused across calls without allocating.
+ */
+void radix_sort(std::vector<uint32_t>& values, std::vector<uint32_t>& scratch);
+
+
+#endif // radix_sort_h
@@ -0,0 +1,218 @@
+#include "region.h"
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+
+
+static const char region_magic[4] = { 'G', 'L', 'C', 'R' };
+static const uint32_t region_version = 1;
+
+
+// Division rounding towards negative infinity, for block coordinates below zero
+static int floor_div(int value, int divisor) {
+	return value >= 0 ? value / divisor : (value - divisor + 1) / divisor;
+}
+
+static void write_u32(std::ofstream& fd, uint32_t value) {
+	const uint8_t data[4] = { uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16), uint8_t(value >> 24) };
+	fd.write((const char*)data, sizeof(data));
+}
+
+static uint32_t read_u32(std::ifstream& fd) {
+	uint8_t data[4];
+
+	if (!fd.read((char*)data, sizeof(data))) {
+		throw std::runtime_error("Unexpected end of region file!");
+	}
+
+	return uint32_t(data[0]) | (uint32_t(data[1]) << 8) | (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24);
+}
+
+
+region::volume::volume(region& r, int ax, int ay, int az) : _region(r), _x(ax * CX), _y(ay * CY), _z(az * CZ) {
+}
+
+uint8_t region::volume::get(int x, int y, int z) const {
+	x += this->_x;
+	y += this->_y;
+	z += this->_z;
+
+	const int cx = floor_div(x, CX);
+	const int cy = floor_div(y, CY);
+	const int cz = floor_div(z, CZ);
+
+	if (!this->_region.contains(cx, cy, cz)) {
+		return 0;
+	}
+
+	return this->_region.blocks(cx, cy, cz)[x - cx * CX][y - cy * CY][z - cz * CZ];
+}
+
+void region::volume::set(int x, int y, int z, uint8_t type) {
+	x += this->_x;
+	y += this->_y;
+	z += this->_z;
+
+	const int cx = floor_div(x, CX);
+	const int cy = floor_div(y, CY);
+	const int cz = floor_div(z, CZ);
+
+	if (!this->_region.contains(cx, cy, cz)) {
+		return;
+	}
+
+	this->_region.blocks(cx, cy, cz)[x - cx * CX][y - cy * CY][z - cz * CZ] = type;
+}
+
+
+region::region(unsigned int seed, int ax, int az, int width, int depth) : _seed(seed), _ax(ax), _az(az), _width(width), _depth(depth) {
+	if (width <= 0 || depth <= 0) {
+		throw std::invalid_argument("Invalid region size!");
+	}
+
+	this->_blocks.resize(size_t(width) * SCY * depth * sizeof(blocks_t));
+}
+
+region region::load(const std::string& path) {
+	std::ifstream fd(path, std::ios::binary);
+
+	if (!fd) {
+		throw std::runtime_error("Failed to open file!");
+	}
+
+	char magic[sizeof(region_magic)];
+
+	if (!fd.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), region_magic) || read_u32(fd) != region_version) {
+		throw std::runtime_error("Not a region file!");
+	}
+
+	// Regions generated with different chunk dimensions can't be used
+	if (read_u32(fd) != CX || read_u32(fd) != CY || read_u32(fd) != CZ || read_u32(fd) != SCY) {
+		throw std::runtime_error("Region was generated with different chunk dimensions!");
+	}
+
+	const unsigned int seed = read_u32(fd);
+	const int ax = int32_t(read_u32(fd));
+	const int az = int32_t(read_u32(fd));
+	const int width = int32_t(read_u32(fd));
+	const int depth = int32_t(read_u32(fd));
+
+	// Runs are at most 255 blocks long, so the rest of the file bounds how many chunks it can hold.
+	// Checking that first keeps a damaged header from allocating gigabytes before the runs run out.
+	const std::streamoff header = fd.tellg();
+	fd.seekg(0, std::ios::end);
+	const std::streamoff remaining = fd.tellg() - header;
+	fd.seekg(header);
+
+	const uint64_t min_chunk_bytes = 2 * sizeof(blocks_t) / 255;
+
+	if (width <= 0 || depth <= 0 || !fd || uint64_t(width) * uint64_t(depth) * SCY > uint64_t(remaining) / min_chunk_bytes) {
+		throw std::runtime_error("Corrupt region file!");
+	}
+
+	region r(seed, ax, az, width, depth);
+
+	uint8_t* it = r._blocks.data();
+	uint8_t* end = it + r._blocks.size();
+
+	while (it != end) {
+		uint8_t run[2];
+
+		if (!fd.read((char*)run, sizeof(run))) {
+			throw std::runtime_error("Unexpected end of region file!");
+		}
+
+		if (run[0] == 0 || run[0] > end - it) {
+			throw std::runtime_error("Corrupt region file!");
+		}
+
+		it = std::fill_n(it, run[0], run[1]);
+	}
+
+	return r;
+}
+
+void region::save(const std::string& path) const {
+	std::ofstream fd(path, std::ios::binary | std::ios::trunc);
+
+	if (!fd) {
+		throw std::runtime_error("Failed to open file!");
+	}
+
+	fd.write(region_magic, sizeof(region_magic));
+	write_u32(fd, region_version);
+	write_u32(fd, CX);
+	write_u32(fd, CY);
+	write_u32(fd, CZ);
+	write_u32(fd, SCY);
+	write_u32(fd, this->_seed);
+	write_u32(fd, uint32_t(this->_ax));
+	write_u32(fd, uint32_t(this->_az));
+	write_u32(fd, uint32_t(this->_width));
+	write_u32(fd, uint32_t(this->_depth));
+
+	// Mostly air and stone, so even a naive RLE shrinks chunks to a fraction of their size
+	std::vector<uint8_t> rle;
+	rle.reserve(this->_blocks.size() / 8);
+
+	for (size_t i = 0; i < this->_blocks.size();) {
+		const uint8_t type = this->_blocks[i];
+		size_t count = 1;
+
+		while (count < 255 && i + count < this->_blocks.size() && this->_blocks[i + count] == type) {
+			count++;
+		}
+
+		rle.push_back(uint8_t(count));
+		rle.push_back(type);
+		i += count;
+	}
+
+	fd.write((const char*)rle.data(), rle.size());
+
+	if (!fd) {
+		throw std::runtime_error("Failed to write region file!");
+	}
+}
+
+unsigned int region::seed() const {
+	return this->_seed;
+}
+
+int region::ax() const {
+	return this->_ax;
+}
+
+int region::az() const {
+	return this->_az;
+}
+
+int region::width() const {
+	return this->_width;
+}
+
+int region::depth() const {
+	return this->_depth;
+}
+
+bool region::contains(int ax, int ay, int az) const {
+	return ax >= this->_ax && ax < this->_ax + this->_width
+	    && ay >= -SCY / 2 && ay < SCY - SCY / 2
+	    && az >= this->_az && az < this->_az + this->_depth;
+}
+
+region::blocks_t& region::blocks(int ax, int ay, int az) {
+	return *reinterpret_cast<blocks_t*>(this->_blocks.data() + this->index(ax, ay, az));
+}
+
+const region::blocks_t& region::blocks(int ax, int ay, int az) const {
+	return *reinterpret_cast<const blocks_t*>(this->_blocks.data() + this->index(ax, ay, az));
+}
+
+size_t region::index(int ax, int ay, int az) const {
+	const size_t x = size_t(ax - this->_ax);
+	const size_t y = size_t(ay + SCY / 2);
+	const size_t z = size_t(az - this->_az);
+	return ((x * SCY + y) * this->_depth + z) * sizeof(blocks_t);
+}
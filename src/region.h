@@ -0,0 +1,64 @@
+#ifndef region_h
+#define region_h
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "world.h"
+
+
+/*
+ * A rectangular area of pre-generated chunks, spanning all SCY chunks vertically.
+ * Chunk coordinates are the same as chunk::_ax/_ay/_az, i.e. the lowest chunk is at ay = -SCY / 2.
+ *
+ * On disk it's stored as a small header followed by every chunk,
+ * run-length encoded as (count, type) byte pairs.
+ */
+class region {
+public:
+	typedef uint8_t blocks_t[CX][CY][CZ];
+
+	// Adapter for worldgen::decoration(), addressing a single chunk with chunk-like get() and set()
+	class volume {
+	public:
+		volume(region& r, int ax, int ay, int az);
+
+		uint8_t get(int x, int y, int z) const;
+		void set(int x, int y, int z, uint8_t type);
+
+	private:
+		region& _region;
+		int _x;
+		int _y;
+		int _z;
+	};
+
+	region(unsigned int seed, int ax, int az, int width, int depth);
+
+	static region load(const std::string& path);
+	void save(const std::string& path) const;
+
+	unsigned int seed() const;
+	int ax() const;
+	int az() const;
+	int width() const;
+	int depth() const;
+
+	bool contains(int ax, int ay, int az) const;
+	blocks_t& blocks(int ax, int ay, int az);
+	const blocks_t& blocks(int ax, int ay, int az) const;
+
+private:
+	size_t index(int ax, int ay, int az) const;
+
+	std::vector<uint8_t> _blocks;
+	unsigned int _seed;
+	int _ax;
+	int _az;
+	int _width;
+	int _depth;
+};
+
+
+#endif // region_h
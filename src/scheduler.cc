@@ -0,0 +1,61 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+
+scheduler::scheduler(double budget_ms) : _pending(), _executed(), _budget(budget_ms / 1000.0), _elapsed(0.0) {
+}
+
+double scheduler::budget() const {
+	return this->_budget * 1000.0;
+}
+
+void scheduler::set_budget(double budget_ms) {
+	this->_budget = budget_ms / 1000.0;
+}
+
+void scheduler::push(stage s, float priority, task_t fn) {
+	this->_queues[s].push_back(task{ priority, std::move(fn) });
+	std::push_heap(this->_queues[s].begin(), this->_queues[s].end());
+}
+
+void scheduler::run() {
+	const auto start = std::chrono::steady_clock::now();
+	double elapsed = 0.0;
+	bool first = true;
+
+	for (int s = 0; s < stage_count; s++) {
+		auto& queue = this->_queues[s];
+
+		this->_pending[s] = queue.size();
+		this->_executed[s] = 0;
+
+		while (!queue.empty() && (first || elapsed < this->_budget)) {
+			std::pop_heap(queue.begin(), queue.end());
+			queue.back().fn();
+			queue.pop_back();
+
+			this->_executed[s]++;
+			elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			first = false;
+		}
+
+		queue.clear();
+	}
+
+	this->_elapsed = elapsed;
+}
+
+size_t scheduler::pending(stage s) const {
+	return this->_pending[s];
+}
+
+size_t scheduler::executed(stage s) const {
+	return this->_executed[s];
+}
+
+double scheduler::elapsed() const {
+	return this->_elapsed;
+}
@@ -0,0 +1,63 @@
+#ifndef scheduler_h
+#define scheduler_h
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+
+/*
+ * Per frame priority queues for chunk streaming work on the main thread.
+ *
+ * Tasks are queued anew every frame with up to date priorities and
+ * run() executes them until the time budget for this frame is spent.
+ * Finished stages come first (uploads before meshing before generation),
+ * so that work already in flight becomes visible as soon as possible.
+ */
+class scheduler {
+public:
+	enum stage {
+		stage_upload,
+		stage_mesh,
+		stage_generate,
+		stage_count,
+	};
+
+	typedef std::function<void()> task_t;
+
+	explicit scheduler(double budget_ms);
+
+	double budget() const;
+	void set_budget(double budget_ms);
+
+	// Lower priorities run first
+	void push(stage s, float priority, task_t fn);
+
+	// Runs tasks until the budget is spent, but at least one, so that streaming never stalls.
+	// Tasks which didn't fit are dropped - they get queued again next frame.
+	void run();
+
+	size_t pending(stage s) const;
+	size_t executed(stage s) const;
+	double elapsed() const;
+
+private:
+	struct task {
+		float priority;
+		task_t fn;
+
+		bool operator<(const task& other) const {
+			return this->priority > other.priority;
+		}
+	};
+
+	// Binary heaps, reusing their storage from frame to frame
+	std::vector<task> _queues[stage_count];
+	size_t _pending[stage_count];
+	size_t _executed[stage_count];
+	double _budget;
+	double _elapsed;
+};
+
+
+#endif // scheduler_h
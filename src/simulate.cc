@@ -0,0 +1,163 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "region.h"
+#include "superchunk.h"
+#include "world.h"
+
+
+/*
+ * Runs the world without a GL context.
+ *
+ * Generates and meshes every chunk, then digs and builds at random spots like a player would,
+ * remeshing whatever an edit touched. Nothing here links against GL, which makes it usable
+ * for benchmarks and as a starting point for servers and other tools.
+ */
+
+static void usage() {
+	std::cerr << "usage: glcraft_simulate [region] [-seed N] [-edits N]" << std::endl;
+	std::cerr << "  The region is a file written by glcraft_pregen, its seed takes precedence." << std::endl;
+}
+
+static bool parse_int(const char* str, long& value) {
+	char* end;
+	value = std::strtol(str, &end, 10);
+	return *str && !*end;
+}
+
+static double seconds_since(const std::chrono::steady_clock::time_point& start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Meshes every chunk which changed and returns the number of vertices built.
+// The meshes are dropped right away, since there is nothing to upload them to.
+static size_t remesh(superchunk& world) {
+	size_t vertices = 0;
+
+	for (int i = 0; i < SCX * SCY * SCZ; i++) {
+		chunk* c = world.at(i);
+
+		if (!c->_changed) {
+			continue;
+		}
+
+		c->mesh();
+		vertices += c->_mesh_vertex.size();
+
+		c->_meshed = false;
+		std::vector<glm::i8vec3>().swap(c->_mesh_vertex);
+		std::vector<glm::i8vec3>().swap(c->_mesh_normal);
+		std::vector<glm::i8vec3>().swap(c->_mesh_uv);
+	}
+
+	return vertices;
+}
+
+int main(int argc, char* argv[]) {
+	const char* region_path = nullptr;
+	long seed = long(time(nullptr));
+	long edits = 1000;
+
+	for (int i = 1; i < argc; i++) {
+		long* value = nullptr;
+
+		if (argv[i][0] != '-') {
+			region_path = argv[i];
+			continue;
+		}
+
+		if (!strcmp(argv[i], "-seed")) {
+			value = &seed;
+		} else if (!strcmp(argv[i], "-edits")) {
+			value = &edits;
+		}
+
+		if (!value || i + 1 >= argc || !parse_int(argv[++i], *value)) {
+			usage();
+			return 1;
+		}
+	}
+
+	if (edits < 0) {
+		usage();
+		return 1;
+	}
+
+	try {
+		superchunk world((unsigned int)seed);
+
+		if (region_path) {
+			world.load(region::load(region_path));
+		}
+
+		srand(world._gen.seed());
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < SCX * SCY * SCZ; i++) {
+			world.generate(world.at(i));
+		}
+
+		const double generate_time = seconds_since(start);
+
+		start = std::chrono::steady_clock::now();
+		const size_t vertices = remesh(world);
+		const double mesh_time = seconds_since(start);
+
+		// Every edit hits the surface of a random column from above
+		const float top = float((SCY - SCY / 2) * CY);
+		long edited = 0;
+
+		start = std::chrono::steady_clock::now();
+
+		for (long i = 0; i < edits; i++) {
+			const int x = rand() % (SCX * CX) - SCX / 2 * CX;
+			const int z = rand() % (SCZ * CZ) - SCZ / 2 * CZ;
+			glm::ivec3 hit;
+			unsigned int face;
+
+			if (!world.raycast(glm::vec3(x + 0.5f, top, z + 0.5f), glm::vec3(0.0f, -1.0f, 0.0f), float(SCY * CY), hit, face)) {
+				continue;
+			}
+
+			// Alternate between digging the block out and building one on top of it
+			if (i & 1) {
+				world.set(hit.x, hit.y + 1, hit.z, uint8_t(rand() % 15 + 1));
+			} else {
+				world.set(hit.x, hit.y, hit.z, 0);
+			}
+
+			remesh(world);
+			edited++;
+		}
+
+		const double edit_time = seconds_since(start);
+		const worldgen::stats& stats = world._gen.timings();
+
+		std::cout << "simulated " << SCX * SCY * SCZ << " chunks with seed " << world._gen.seed() << std::endl;
+		std::cout << "  generate:   " << generate_time * 1000.0 << " ms, " << SCX * SCY * SCZ / generate_time << " chunks/s" << std::endl;
+		std::cout << "    heightmap:  " << stats.heightmap * 1000.0 << " ms" << std::endl;
+		std::cout << "    strata:     " << stats.strata * 1000.0 << " ms" << std::endl;
+		std::cout << "    fluids:     " << stats.fluids * 1000.0 << " ms" << std::endl;
+		std::cout << "    decoration: " << stats.decoration * 1000.0 << " ms" << std::endl;
+		std::cout << "  mesh:       " << mesh_time * 1000.0 << " ms, " << vertices << " vertices" << std::endl;
+
+		if (edited) {
+			std::cout << "  edits:      " << edited << " in " << edit_time * 1000.0 << " ms, " << edit_time * 1000.0 / edited << " ms per edit" << std::endl;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << std::endl;
+		return 127;
+	}
+
+	return 0;
+}
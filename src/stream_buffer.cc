@@ -0,0 +1,96 @@
+#include "stream_buffer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "gl_service.h"
+
+
+stream_buffer::stream_buffer(size_t frame_size) : _buffer(0), _mapping(nullptr), _fences(), _frame_size(frame_size), _frame(0), _offset(0) {
+	const size_t size = frame_size * frames;
+
+	glGenBuffers(1, &this->_buffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, this->_buffer);
+
+	if (GLEW_ARB_buffer_storage) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+		this->_mapping = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+
+		if (!this->_mapping) {
+			throw std::runtime_error("failed to map the stream buffer");
+		}
+	} else {
+		glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	}
+}
+
+stream_buffer::~stream_buffer() {
+	for (GLsync fence : this->_fences) {
+		if (fence) {
+			glDeleteSync(fence);
+		}
+	}
+
+	if (this->_mapping) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, this->_buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	}
+
+	glDeleteBuffers(1, &this->_buffer);
+}
+
+size_t stream_buffer::write(const void* data, size_t size, size_t align) {
+	this->_offset = (this->_offset + align - 1) / align * align;
+
+	if (this->_offset + size > this->_frame_size) {
+		throw std::runtime_error("stream buffer overflow");
+	}
+
+	const size_t offset = this->_frame * this->_frame_size + this->_offset;
+
+	if (this->_mapping) {
+		memcpy(this->_mapping + offset, data, size);
+	} else {
+		// The fences guarantee that the GPU isn't reading this range anymore
+		glBindBuffer(GL_COPY_WRITE_BUFFER, this->_buffer);
+		void* mapping = glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+
+		if (!mapping) {
+			throw std::runtime_error("failed to map the stream buffer");
+		}
+
+		memcpy(mapping, data, size);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	}
+
+	gl_service::counters().uploaded(size);
+
+	this->_offset += (size + alignment - 1) / alignment * alignment;
+	return offset;
+}
+
+void stream_buffer::end_frame() {
+	this->_fences[this->_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	this->_frame = (this->_frame + 1) % frames;
+	this->_offset = 0;
+
+	GLsync& fence = this->_fences[this->_frame];
+
+	if (fence) {
+		while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+		}
+
+		glDeleteSync(fence);
+		fence = nullptr;
+	}
+}
+
+GLuint stream_buffer::buffer() const {
+	return this->_buffer;
+}
+
+bool stream_buffer::persistent() const {
+	return this->_mapping != nullptr;
+}
@@ -0,0 +1,56 @@
+#ifndef stream_buffer_h
+#define stream_buffer_h
+
+#include <cstddef>
+#include <cstdint>
+
+#include <GL/glew.h>
+
+
+/*
+ * Ring buffer for vertex data which changes every frame.
+ *
+ * The buffer is split into one region per frame in flight. Writes go into the region
+ * of the current frame, which is fenced by end_frame() and only reused once the GPU
+ * is done with it, so the driver never has to orphan or reallocate anything.
+ * Where GL_ARB_buffer_storage is available the buffer stays mapped persistently,
+ * otherwise every write maps its range unsynchronized.
+ */
+class stream_buffer {
+public:
+	enum {
+		frames = 3,
+		alignment = 16,
+	};
+
+	// Takes the number of bytes which can be written per frame
+	explicit stream_buffer(size_t frame_size);
+	~stream_buffer();
+
+	stream_buffer(const stream_buffer&) = delete;
+	stream_buffer& operator=(const stream_buffer&) = delete;
+
+	/*
+	 * Copies the data into the buffer and returns its offset, which stays valid until end_frame().
+	 * Offsets are multiples of align, like GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT for uniform blocks,
+	 * as long as it divides the frame size.
+	 */
+	size_t write(const void* data, size_t size, size_t align = alignment);
+
+	// Fences everything written this frame and waits until the region of the next one is free again
+	void end_frame();
+
+	GLuint buffer() const;
+	bool persistent() const;
+
+private:
+	GLuint _buffer;
+	uint8_t* _mapping;
+	GLsync _fences[frames];
+	size_t _frame_size;
+	size_t _frame;
+	size_t _offset;
+};
+
+
+#endif // stream_buffer_h
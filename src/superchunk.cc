@@ -0,0 +1,199 @@
+#include "superchunk.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+
+// Division rounding towards negative infinity, for block coordinates left of the superchunk
+static int floor_div(int value, int divisor) {
+	return value >= 0 ? value / divisor : (value - divisor + 1) / divisor;
+}
+
+
+superchunk::superchunk(unsigned int seed) : _gen(seed) {
+	for (int x = 0; x < SCX; x++) {
+		for (int y = 0; y < SCY; y++) {
+			for (int z = 0; z < SCZ; z++) {
+				this->_c[x][y][z] = new chunk(x - SCX / 2, y - SCY / 2, z - SCZ / 2);
+			}
+		}
+	}
+
+	for (int x = 0; x < SCX; x++) {
+		for (int y = 0; y < SCY; y++) {
+			for (int z = 0; z < SCZ; z++) {
+				if (x > 0) {
+					this->_c[x][y][z]->_left = this->_c[x - 1][y][z];
+				}
+
+				if (x < SCX - 1) {
+					this->_c[x][y][z]->_right = this->_c[x + 1][y][z];
+				}
+
+				if (y > 0) {
+					this->_c[x][y][z]->_below = this->_c[x][y - 1][z];
+				}
+
+				if (y < SCY - 1) {
+					this->_c[x][y][z]->_above = this->_c[x][y + 1][z];
+				}
+
+				if (z > 0) {
+					this->_c[x][y][z]->_front = this->_c[x][y][z - 1];
+				}
+
+				if (z < SCZ - 1) {
+					this->_c[x][y][z]->_back = this->_c[x][y][z + 1];
+				}
+			}
+		}
+	}
+}
+
+superchunk::~superchunk() {
+	for (int i = 0; i < SCX * SCY * SCZ; i++) {
+		delete this->at(i);
+	}
+}
+
+void superchunk::on_touch(const std::function<void(const chunk*, int)>& fn) {
+	this->_touch = fn;
+}
+
+int superchunk::index(const chunk* c) const {
+	return ((c->_ax + SCX / 2) * SCY + (c->_ay + SCY / 2)) * SCZ + (c->_az + SCZ / 2);
+}
+
+chunk* superchunk::at(int index) const {
+	return (&this->_c[0][0][0])[index];
+}
+
+void superchunk::load(const region& r) {
+	this->_gen = worldgen(r.seed());
+
+	for (int x = 0; x < SCX; x++) {
+		for (int y = 0; y < SCY; y++) {
+			for (int z = 0; z < SCZ; z++) {
+				chunk* c = this->_c[x][y][z];
+
+				if (r.contains(c->_ax, c->_ay, c->_az)) {
+					memcpy(c->_blk, r.blocks(c->_ax, c->_ay, c->_az), sizeof(c->_blk));
+					c->_noised = true;
+					c->_changed = true;
+				}
+			}
+		}
+	}
+}
+
+uint8_t superchunk::get(int x, int y, int z) const {
+	int cx = floor_div(x + CX * (SCX / 2), CX);
+	int cy = floor_div(y + CY * (SCY / 2), CY);
+	int cz = floor_div(z + CZ * (SCZ / 2), CZ);
+
+	if (cx < 0 || cx >= SCX || cy < 0 || cy >= SCY || cz < 0 || cz >= SCZ) {
+		return 0;
+	}
+
+	return this->_c[cx][cy][cz]->get(x & (CX - 1), y & (CY - 1), z & (CZ - 1));
+}
+
+void superchunk::set(int x, int y, int z, uint8_t type) {
+	int cx = floor_div(x + CX * (SCX / 2), CX);
+	int cy = floor_div(y + CY * (SCY / 2), CY);
+	int cz = floor_div(z + CZ * (SCZ / 2), CZ);
+
+	if (cx < 0 || cx >= SCX || cy < 0 || cy >= SCY || cz < 0 || cz >= SCZ) {
+		return;
+	}
+
+	this->_c[cx][cy][cz]->set(x & (CX - 1), y & (CY - 1), z & (CZ - 1), type);
+
+	// The neighbouring chunks might need a new mesh as well
+	this->touch(this->_c[cx][cy][cz], 1);
+}
+
+void superchunk::generate(chunk* c) {
+	c->noise(this->_gen);
+
+	if (c->_left) {
+		c->_left->noise(this->_gen);
+	}
+
+	if (c->_right) {
+		c->_right->noise(this->_gen);
+	}
+
+	if (c->_below) {
+		c->_below->noise(this->_gen);
+	}
+
+	if (c->_above) {
+		c->_above->noise(this->_gen);
+	}
+
+	if (c->_front) {
+		c->_front->noise(this->_gen);
+	}
+
+	if (c->_back) {
+		c->_back->noise(this->_gen);
+	}
+
+	c->_initialized = true;
+
+	// Trees of the neighbours may have grown into the chunks next to them
+	this->touch(c, 2);
+}
+
+bool superchunk::raycast(const glm::vec3& origin, const glm::vec3& direction, float max_distance, glm::ivec3& hit, unsigned int& hit_face) const {
+	const glm::ivec3 min(-SCX / 2 * CX, -SCY / 2 * CY, -SCZ / 2 * CZ);
+	const glm::ivec3 max((SCX - SCX / 2) * CX, (SCY - SCY / 2) * CY, (SCZ - SCZ / 2) * CZ);
+
+	glm::ivec3 block(int(floorf(origin.x)), int(floorf(origin.y)), int(floorf(origin.z)));
+	glm::ivec3 step;
+	glm::vec3 delta;
+	glm::vec3 next;
+
+	// For every axis, the distance along the ray between two block boundaries, and to the next one
+	for (int axis = 0; axis < 3; axis++) {
+		step[axis] = direction[axis] > 0.0f ? 1 : -1;
+
+		if (direction[axis] == 0.0f) {
+			delta[axis] = std::numeric_limits<float>::infinity();
+			next[axis] = std::numeric_limits<float>::infinity();
+			continue;
+		}
+
+		delta[axis] = fabsf(1.0f / direction[axis]);
+		next[axis] = (step[axis] > 0 ? float(block[axis] + 1) - origin[axis] : origin[axis] - float(block[axis])) * delta[axis];
+	}
+
+	for (;;) {
+		const int axis = next.x < next.y ? (next.x < next.z ? 0 : 2) : (next.y < next.z ? 1 : 2);
+
+		if (next[axis] > max_distance) {
+			return false;
+		}
+
+		block[axis] += step[axis];
+		next[axis] += delta[axis];
+
+		if (block.x < min.x || block.y < min.y || block.z < min.z || block.x >= max.x || block.y >= max.y || block.z >= max.z) {
+			continue;
+		}
+
+		if (this->get(block.x, block.y, block.z)) {
+			hit = block;
+			hit_face = axis + (step[axis] > 0 ? 3 : 0);
+			return true;
+		}
+	}
+}
+
+void superchunk::touch(const chunk* c, int radius) {
+	if (this->_touch) {
+		this->_touch(c, radius);
+	}
+}
@@ -0,0 +1,63 @@
+#ifndef superchunk_h
+#define superchunk_h
+
+#include <cstdint>
+#include <functional>
+
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "region.h"
+#include "world.h"
+#include "worldgen.h"
+
+
+/*
+ * All SCX * SCY * SCZ chunks of the world and the generator filling them.
+ *
+ * It doesn't depend on GL in any way and can be generated, edited and queried
+ * without a context, e.g. by tools and benchmarks. A renderer listens to
+ * on_touch() to find out which parts of the world need to be drawn anew.
+ */
+struct superchunk {
+	chunk* _c[SCX][SCY][SCZ];
+	worldgen _gen;
+
+	explicit superchunk(unsigned int seed);
+	~superchunk();
+
+	superchunk(const superchunk&) = delete;
+	superchunk& operator=(const superchunk&) = delete;
+
+	// Called with every chunk whose blocks changed, and the radius in chunks around it which is affected
+	void on_touch(const std::function<void(const chunk*, int)>& fn);
+
+	// Chunks are indexed in the same order as _c
+	int index(const chunk* c) const;
+	chunk* at(int index) const;
+
+	// Replaces the chunks covered by a pre-generated region and continues generating the rest with its seed
+	void load(const region& r);
+
+	// In block coordinates
+	uint8_t get(int x, int y, int z) const;
+	void set(int x, int y, int z, uint8_t type);
+
+	// Generates the chunk and its neighbours, which are needed to mesh its edges
+	void generate(chunk* c);
+
+	/*
+	 * Walks the blocks along the ray one at a time (Amanatides & Woo) and returns the first one which isn't air,
+	 * together with the face it was entered through: 0-2 for the positive x/y/z faces, 3-5 for the negative ones.
+	 * The block the ray starts in is skipped, since its faces point away from it.
+	 */
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float max_distance, glm::ivec3& hit, unsigned int& hit_face) const;
+
+private:
+	void touch(const chunk* c, int radius);
+
+	std::function<void(const chunk*, int)> _touch;
+};
+
+
+#endif // superchunk_h
@@ -0,0 +1,86 @@
+#include "trace.h"
+
+#include <fstream>
+#include <stdexcept>
+
+
+trace_recorder::trace_recorder() : _recording(false), _capacity(0), _dropped(0), _epoch(std::chrono::steady_clock::now()) {
+}
+
+trace_recorder& trace_recorder::instance() {
+	static trace_recorder recorder;
+	return recorder;
+}
+
+void trace_recorder::start(size_t max_bytes) {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+
+	this->_events.clear();
+	this->_capacity = max_bytes / sizeof(event);
+	this->_events.reserve(this->_capacity);
+	this->_dropped = 0;
+	this->_recording = true;
+}
+
+void trace_recorder::stop() {
+	this->_recording = false;
+}
+
+bool trace_recorder::recording() const {
+	return this->_recording.load(std::memory_order_relaxed);
+}
+
+void trace_recorder::complete(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+	if (this->recording()) {
+		this->push(name, start, std::chrono::duration<double, std::micro>(end - start).count());
+	}
+}
+
+size_t trace_recorder::events() const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	return this->_events.size();
+}
+
+size_t trace_recorder::dropped() const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	return this->_dropped;
+}
+
+void trace_recorder::write(const std::string& path) const {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+	std::ofstream fd(path, std::ios::trunc);
+
+	if (!fd) {
+		throw std::runtime_error("Failed to open file!");
+	}
+
+	fd << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	for (size_t i = 0; i < this->_events.size(); i++) {
+		const event& e = this->_events[i];
+
+		fd << (i ? ",\n" : "\n");
+		fd << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid << ",\"ts\":" << std::fixed << e.ts << ",\"dur\":" << e.dur << "}";
+	}
+
+	fd << "\n]}" << std::endl;
+}
+
+void trace_recorder::push(const char* name, std::chrono::steady_clock::time_point ts, double dur) {
+	std::lock_guard<std::mutex> lock(this->_mutex);
+
+	// Another thread might have stopped the recording while this one was waiting
+	if (!this->_recording) {
+		return;
+	}
+
+	if (this->_events.size() >= this->_capacity) {
+		this->_dropped++;
+		return;
+	}
+
+	// Small thread ids in the order threads show up, they are easier to tell apart than the native ones
+	const auto it = this->_tids.emplace(std::this_thread::get_id(), uint32_t(this->_tids.size() + 1)).first;
+
+	this->_events.push_back({ name, it->second, std::chrono::duration<double, std::micro>(ts - this->_epoch).count(), dur });
+}
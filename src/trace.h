@@ -0,0 +1,91 @@
+#ifndef trace_h
+#define trace_h
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+
+/*
+ * Records what every thread was doing when, for chrome://tracing or Perfetto.
+ *
+ * Events are only recorded between start() and stop(), until the memory given to start() is
+ * used up, after which further events are dropped. Outside of that TRACE_SCOPE() costs a single
+ * atomic load, so unlike the profiler it's compiled into every build and can be used on demand.
+ * Event names must be string literals (they are stored as pointers) which need no JSON escaping.
+ *
+ * Every event is a complete ('X') one, recorded once its scope has ended, so dropping events
+ * can never leave a slice open like a 'B' event whose 'E' didn't fit anymore would.
+ */
+class trace_recorder {
+public:
+	// Records an 'X' event covering the lifetime of the scope
+	class scope {
+	public:
+		explicit scope(const char* name) : _name(name), _recording(trace_recorder::instance().recording()) {
+			if (this->_recording) {
+				this->_start = std::chrono::steady_clock::now();
+			}
+		}
+
+		~scope() {
+			if (this->_recording) {
+				trace_recorder::instance().complete(this->_name, this->_start, std::chrono::steady_clock::now());
+			}
+		}
+
+	private:
+		const char* _name;
+		bool _recording;
+		std::chrono::steady_clock::time_point _start;
+	};
+
+	static trace_recorder& instance();
+
+	// Clears previous events and records until stop() or until max_bytes worth of events were recorded
+	void start(size_t max_bytes);
+	void stop();
+	bool recording() const;
+
+	void complete(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+
+	size_t events() const;
+	size_t dropped() const;
+
+	// In the JSON object format of the Trace Event Format
+	void write(const std::string& path) const;
+
+private:
+	struct event {
+		const char* name;
+		uint32_t tid;
+		double ts;  // microseconds since the recorder was created
+		double dur;
+	};
+
+	trace_recorder();
+
+	void push(const char* name, std::chrono::steady_clock::time_point ts, double dur);
+
+	std::atomic<bool> _recording;
+	mutable std::mutex _mutex;
+	std::vector<event> _events;
+	size_t _capacity;
+	size_t _dropped;
+	std::unordered_map<std::thread::id, uint32_t> _tids;
+	std::chrono::steady_clock::time_point _epoch;
+};
+
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) trace_recorder::scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+
+#endif // trace_h
@@ -0,0 +1,19 @@
+#ifndef world_h
+#define world_h
+
+
+// Size of one chunk in blocks
+#define CX 16
+#define CY 32
+#define CZ 16
+
+// Number of chunks in the world
+#define SCX 32
+#define SCY 2
+#define SCZ 32
+
+// Sea level
+#define SEALEVEL 4
+
+
+#endif // world_h
@@ -0,0 +1,188 @@
+#include "worldgen.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+
+worldgen::worldgen(unsigned int seed, size_t cached_columns) : _cached_columns(std::max<size_t>(cached_columns, 1)), _column_clock(0), _noise(seed), _stats(), _seed(seed) {
+}
+
+unsigned int worldgen::seed() const {
+	return this->_seed;
+}
+
+const worldgen::stats& worldgen::timings() const {
+	return this->_stats;
+}
+
+const worldgen::column& worldgen::heightmap(int ax, int az) {
+	const uint64_t key = (uint64_t(uint32_t(ax)) << 32) | uint32_t(az);
+	auto it = this->_columns.find(key);
+
+	this->_column_clock++;
+
+	if (it != this->_columns.end()) {
+		it->second.used = this->_column_clock;
+		return it->second.col;
+	}
+
+	if (this->_columns.size() >= this->_cached_columns) {
+		this->trim_columns();
+	}
+
+	stage_timer timer(this->_stats.heightmap);
+	this->_stats.columns++;
+
+	cached_column& cached = this->_columns[key];
+	cached.used = this->_column_clock;
+
+	column& col = cached.col;
+	col.hmin = std::numeric_limits<int>::max();
+	col.hmax = std::numeric_limits<int>::min();
+
+	for (int x = 0; x < CX; x++) {
+		for (int z = 0; z < CZ; z++) {
+			// Land height - 5 octaves of noise
+			float sum = 0.0f;
+			float strength = 1.0;
+			float scale = 1.0;
+
+			for (int i = 0; i < 5; i++) {
+				sum += strength * this->_noise.noise2((x + ax * CX) / 256.0f * scale, (z + az * CZ) / 256.0f * scale);
+				scale *= 2.0;
+				strength *= 0.8f;
+			}
+
+			const float n = sum * 4.0f;
+			const int h = int(n * 2);
+
+			col.n[x][z] = n;
+			col.h[x][z] = h;
+			col.hmin = std::min(col.hmin, h);
+			col.hmax = std::max(col.hmax, h);
+		}
+	}
+
+	return col;
+}
+
+// Drops the older half of the cached columns at once, so that the search for them is rare
+void worldgen::trim_columns() {
+	std::vector<uint64_t> used;
+	used.reserve(this->_columns.size());
+
+	for (const auto& it : this->_columns) {
+		used.push_back(it.second.used);
+	}
+
+	const auto median = used.begin() + used.size() / 2;
+	std::nth_element(used.begin(), median, used.end());
+
+	for (auto it = this->_columns.begin(); it != this->_columns.end();) {
+		if (it->second.used <= *median) {
+			it = this->_columns.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void worldgen::strata(uint8_t (&blk)[CX][CY][CZ], const column& col, int ax, int ay, int az) {
+	stage_timer timer(this->_stats.strata);
+	this->_stats.chunks++;
+
+	const int base = ay * CY;
+
+	// The whole chunk is above the terrain
+	if (col.hmax <= base) {
+		return;
+	}
+
+	for (int x = 0; x < CX; x++) {
+		for (int z = 0; z < CZ; z++) {
+			const float n = col.n[x][z];
+			const int h = col.h[x][z];
+			const int top = std::min(h - base, CY);
+
+			// The land type is decided by n + r * 5 with r in [0, 2], since it's
+			// the sum of 2 octaves of abs(simplex). Columns where even the largest r
+			// stays below the sand threshold are sand at any depth and can skip noise3d_abs().
+			if (n + 2.0f * 5 < 4) {
+				for (int y = 0; y < top; y++) {
+					blk[x][y][z] = 7;
+				}
+
+				continue;
+			}
+
+			for (int y = 0; y < top; y++) {
+				// Random value used to determine land type
+				float r = noise3d_abs((x + ax * CX) / 16.0f, (y + base) / 16.0f, (z + az * CZ) / 16.0f, 2, 1.0f);
+
+				if (n + r * 5 < 4) {
+					// Sand layer
+					blk[x][y][z] = 7;
+				} else if (n + r * 5 < 8) {
+					// Dirt layer, but use grass blocks for the top
+					blk[x][y][z] = (h < SEALEVEL || y + base < h - 1) ? 1 : 3;
+				} else if (r < 1.25) {
+					// Rock layer
+					blk[x][y][z] = 6;
+				} else {
+					// Sometimes, ores!
+					blk[x][y][z] = 11;
+				}
+			}
+		}
+	}
+}
+
+void worldgen::fluids(uint8_t (&blk)[CX][CY][CZ], const column& col, int ay) {
+	stage_timer timer(this->_stats.fluids);
+
+	const int base = ay * CY;
+
+	// The whole chunk is above the sea or below the terrain
+	if (base >= SEALEVEL || col.hmin >= base + CY) {
+		return;
+	}
+
+	const int top = std::min(SEALEVEL - base, CY);
+
+	for (int x = 0; x < CX; x++) {
+		for (int z = 0; z < CZ; z++) {
+			for (int y = std::max(col.h[x][z] - base, 0); y < top; y++) {
+				blk[x][y][z] = 8;
+			}
+		}
+	}
+}
+
+uint32_t worldgen::random_seed(int ax, int ay, int az) const {
+	// murmur3 finalizer over the seed and chunk coordinates
+	uint32_t h = this->_seed ^ (uint32_t(ax) * 0x9e3779b1u) ^ (uint32_t(ay) * 0x85ebca77u) ^ (uint32_t(az) * 0xc2b2ae3du);
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+
+	// xorshift32 gets stuck on 0
+	return h ? h : 1;
+}
+
+float worldgen::noise3d_abs(float x, float y, float z, int octaves, float persistence) const {
+	float sum = 0;
+	float strength = 1.0;
+	float scale = 1.0;
+
+	for (int i = 0; i < octaves; i++) {
+		sum += strength * fabsf(this->_noise.noise3(x * scale, y * scale, z * scale));
+		scale *= 2.0;
+		strength *= persistence;
+	}
+
+	return sum;
+}
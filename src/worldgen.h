@@ -0,0 +1,151 @@
+#ifndef worldgen_h
+#define worldgen_h
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include "noise.h"
+#include "world.h"
+
+
+/*
+ * Terrain generation, split into 4 stages which are run for each chunk in this order:
+ *
+ *   heightmap  - land noise and height of every column, cached for the most recently used chunk columns
+ *   strata     - sand, dirt, grass, rock and ores below the terrain height
+ *   fluids     - water between the terrain height and the sea level
+ *   decoration - trees, which may reach into the neighbouring chunks
+ *
+ * Chunks stacked on top of each other share the same heightmap.
+ * An instance is not thread-safe, but separate instances may be used concurrently.
+ */
+class worldgen {
+public:
+	struct column {
+		float n[CX][CZ]; // land noise - decides the strata as well
+		int h[CX][CZ];   // terrain height in blocks
+		int hmin;
+		int hmax;
+	};
+
+	// Accumulated time spent in each stage in seconds
+	struct stats {
+		double heightmap;
+		double strata;
+		double fluids;
+		double decoration;
+		uint64_t columns;
+		uint64_t chunks;
+	};
+
+	enum {
+		default_cached_columns = 2 * SCX * SCZ,
+	};
+
+	// At most cached_columns heightmaps are kept, the least recently used ones are dropped first
+	explicit worldgen(unsigned int seed, size_t cached_columns = default_cached_columns);
+
+	unsigned int seed() const;
+	const stats& timings() const;
+
+	// The column stays valid until the next call
+	const column& heightmap(int ax, int az);
+	void strata(uint8_t (&blk)[CX][CY][CZ], const column& col, int ax, int ay, int az);
+	void fluids(uint8_t (&blk)[CX][CY][CZ], const column& col, int ay);
+
+	// T needs to provide get() and set() like chunk does, forwarding coordinates outside of it to its neighbours.
+	template<typename T>
+	void decoration(T& c, const column& col, int ax, int ay, int az) {
+		stage_timer timer(this->_stats.decoration);
+
+		const int base = ay * CY;
+
+		// Seeded per chunk, so that trees don't depend on the order (or thread) chunks are generated in
+		uint32_t rng = random_seed(ax, ay, az);
+
+		// Trees only grow on top of the terrain and never below the sea level
+		if (col.hmax < std::max(base, SEALEVEL) || col.hmin >= base + CY) {
+			return;
+		}
+
+		for (int x = 0; x < CX; x++) {
+			for (int z = 0; z < CZ; z++) {
+				const int h = col.h[x][z];
+
+				if (h < std::max(base, SEALEVEL) || h >= base + CY) {
+					continue;
+				}
+
+				const int y = h - base;
+
+				// A tree!
+				if (c.get(x, y - 1, z) == 3 && (next_random(rng) & 0xff) == 0) {
+					// Trunk
+					const int height = int(next_random(rng) & 0x3) + 3;
+
+					for (int i = 0; i < height; i++) {
+						c.set(x, y + i, z, 5);
+					}
+
+					// Leaves
+					for (int ix = -3; ix <= 3; ix++) {
+						for (int iy = -3; iy <= 3; iy++) {
+							for (int iz = -3; iz <= 3; iz++) {
+								if (ix * ix + iy * iy + iz * iz < 8 + int(next_random(rng) & 1) && !c.get(x + ix, y + height + iy, z + iz)) {
+									c.set(x + ix, y + height + iy, z + iz, 4);
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+
+private:
+	class stage_timer {
+	public:
+		explicit stage_timer(double& total) : _total(total), _start(std::chrono::steady_clock::now()) {
+		}
+
+		~stage_timer() {
+			this->_total += std::chrono::duration<double>(std::chrono::steady_clock::now() - this->_start).count();
+		}
+
+	private:
+		double& _total;
+		std::chrono::steady_clock::time_point _start;
+	};
+
+	// xorshift32 - unlike rand() it yields the same sequence on every platform
+	static uint32_t next_random(uint32_t& state) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	uint32_t random_seed(int ax, int ay, int az) const;
+
+	float noise3d_abs(float x, float y, float z, int octaves, float persistence) const;
+
+	void trim_columns();
+
+	struct cached_column {
+		column col;
+		uint64_t used; // _column_clock when it was last asked for
+	};
+
+	std::unordered_map<uint64_t, cached_column> _columns;
+	size_t _cached_columns;
+	uint64_t _column_clock;
+	simplex_noise _noise;
+	stats _stats;
+	unsigned int _seed;
+};
+
+
+#endif // worldgen_h